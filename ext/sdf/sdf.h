@@ -24,6 +24,8 @@
 #ifndef SDF_H
 #define SDF_H
 
+#include <stddef.h>
+
 // Sweep-and-update Euclidean distance transform of an antialised image for contour textures.
 // Based on edtaa3func.c by Stefan Gustavson.
 //
@@ -46,14 +48,229 @@
 int sdfBuildDistanceField(unsigned char *out, int outstride, float outside_radius, float inside_radius,
                           const unsigned char *img, int width, int height, int stride);
 
-// Same as distXform, but does not allocate any memory.
-// The 'temp' array should be enough to fit width * height * sizeof(float) * 3 bytes.
+// Same as sdfBuildDistanceField, but does not allocate any memory.
+// The 'temp' array should be at least sdfEngineTempSize(width, height, 1, SDF_ENGINE_8SSEDT) bytes.
 void sdfBuildDistanceFieldNoAlloc(unsigned char *out, int outstride, float outside_radius, float inside_radius,
                                   const unsigned char *img, int width, int height, int stride,
                                   unsigned char *temp);
 
+// Distance propagation engines.
+enum SDFengine
+{
+    SDF_ENGINE_8SSEDT = 0, // 8-point sequential sweep-and-update, approximate, cost depends on the data.
+    SDF_ENGINE_EXACT = 1,  // Separable linear time Euclidean transform (Felzenszwalb-Huttenlocher), O(width*height).
+    // 8SSEDT, then passes looking two pixels away until one changes nothing, at most SDF_MAX_PASSES
+    // (10) passes. They fix most of the errors of the single pass behind concave shapes. The passes
+    // after the second only sweep the rows next to a change, so their cost follows the shape.
+    SDF_ENGINE_8SSEDT_ADAPTIVE = 2,
+};
+
+// Returns the number of bytes the 'temp' array must hold for the NoAlloc functions running 'engine' on
+// up to 'threads' threads: 12 bytes per pixel for the 8SSEDT engines, 16 for SDF_ENGINE_EXACT, which also
+// keeps a line position per pixel, plus a few KB of line scratch per thread.
+size_t sdfEngineTempSize(int width, int height, int threads, int engine);
+
+// sdfEngineTempSize() of the largest engine, enough for any of the NoAlloc functions.
+// Defining SDF_COMPACT_SCRATCH with SDF_IMPLEMENTATION stores the nearest contour point of each pixel as
+// a 16-bit offset in 1/32 pixels with an integer squared distance, 4 bytes per pixel less: 8 instead of
+// 12 for the 8SSEDT engines, 12 instead of 16 for SDF_ENGINE_EXACT.
+// Distances above 1023 pixels saturate, and the output can differ by 1 from the default layout.
+size_t sdfTempSize(int width, int height, int threads);
+
+// Same as sdfBuildDistanceFieldNoAlloc, but the distances are propagated with SDF_ENGINE_EXACT.
+// The subpixel contour points are found exactly like for the 8SSEDT, then the nearest point is
+// searched with 1D lower envelopes of parabolas, once per column and once per row. The cost does
+// not depend on the image content, and every column or row is independent of the others.
+// Unlike the 8SSEDT, the image border pixels are calculated too.
+// The 'temp' array should be at least sdfEngineTempSize(width, height, 1, SDF_ENGINE_EXACT) bytes.
+void sdfBuildDistanceFieldExactNoAlloc(unsigned char *out, int outstride, float outside_radius, float inside_radius,
+                                       const unsigned char *img, int width, int height, int stride,
+                                       unsigned char *temp);
+
+// Same as sdfBuildDistanceField, but the engine is selected at runtime, see SDFengine, and the work
+// is split over 'threads' threads. The result is the same for any thread count.
+// The edge and remap passes are split by rows, SDF_ENGINE_EXACT also splits its column and row passes;
+// the 8SSEDT sweeps are sequential and always run on the calling thread.
+// The input and output may be one channel of an interleaved image: point 'img' and 'out' at the
+// channel byte of the first pixel (e.g. rgba + 3 for alpha) and set the pixel strides to the pixel size.
+// Input and output can be the same buffer, so a channel can be baked in place.
+//   outpixstride - Bytes per pixel on output image.
+//   pixstride - Bytes per pixel on input image.
+// Returns 0 if the temp memory could not be allocated or the engine is unknown.
+int sdfBuildDistanceFieldEx(unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                            const unsigned char *img, int width, int height, int stride, int pixstride,
+                            int engine, int threads);
+
+// Same as sdfBuildDistanceFieldEx, but does not allocate any memory.
+// The 'temp' array should be at least sdfEngineTempSize(width, height, threads, engine) bytes.
+void sdfBuildDistanceFieldExNoAlloc(unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                                   const unsigned char *img, int width, int height, int stride, int pixstride,
+                                   int engine, int threads, unsigned char *temp);
+
+// A context keeps the temp memory and the worker threads alive between builds, so baking many images,
+// or the same image again, does not allocate nor start threads once the temp memory fits the largest image.
+typedef struct SDFcontext SDFcontext;
+
+// Context creation flags.
+enum SDFcontextFlags
+{
+    SDF_CONTEXT_HUGE_PAGES = 1 << 0, // Back the temp memory with huge pages when the OS grants them, normal pages otherwise.
+    SDF_CONTEXT_NARROW_BAND = 1 << 1, // Transform only the tiles within the radius of a contour, see below.
+};
+
+// Creates a context running its builds on 'threads' threads, the calling thread included.
+// Returns NULL if the context could not be allocated.
+SDFcontext *sdfCreateContext(int threads, int flags);
+void sdfDeleteContext(SDFcontext *ctx);
+
+// Same as sdfBuildDistanceFieldEx, using the context temp memory and threads. The temp memory
+// grows only when the image needs more than it currently holds, and is never shrunk.
+// Returns 0 if the temp memory could not be allocated or the engine is unknown.
+int sdfContextBuild(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                    const unsigned char *img, int width, int height, int stride, int pixstride, int engine);
+
+// Same as sdfContextBuild, but builds up to four independent distance fields in one traversal of an
+// interleaved image. Bit i of 'channels' selects the byte at offset i of every pixel, e.g. 0xf bakes
+// all of RGBA and 0x9 only red and alpha. The transform state of the selected channels is kept
+// interleaved, so every cache line fetched serves all of them; the temp memory grows accordingly.
+// The result of each channel is the same as baking it alone.
+// With SDF_CONTEXT_NARROW_BAND, the image is split in 32x32 tiles and only the tiles within the larger
+// of the two radii of a contour are transformed, the others are filled with 0 or 255 directly. Masks
+// that are mostly empty space around thin shapes bake many times faster. The exact engine gives the
+// same result as without the band, the 8SSEDT one can differ by a few steps near the radius.
+int sdfContextBuildChannels(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride,
+                            float outside_radius, float inside_radius, const unsigned char *img, int width, int height,
+                            int stride, int pixstride, int channels, int engine);
+
+// Output sample formats. 'd' is the signed distance to the contour in pixels, positive inside the shape
+// and negative outside, clamped to [-outside_radius, inside_radius].
+enum SDFformat
+{
+    SDF_FORMAT_UNORM8 = 0,  // 255 * (0.5 + 0.5 * d / radius), the bytes of the other builds.
+    SDF_FORMAT_UNORM16 = 1, // 65535 * (0.5 + 0.5 * d / radius), for large radii that band in 8 bits.
+    SDF_FORMAT_HALF = 2,    // d as an IEEE half float.
+    SDF_FORMAT_FLOAT = 3,   // d as a float.
+};
+
+// Same as sdfContextBuildChannels, but writes the samples in 'format', see SDFformat. The strides count
+// samples, and each selected channel goes to the sample at its byte offset. The input is only read;
+// unless the format is SDF_FORMAT_UNORM8, the output must be another buffer.
+int sdfContextBuildFormat(SDFcontext *ctx, void *out, int outstride, int outpixstride, int format,
+                          float outside_radius, float inside_radius, const unsigned char *img, int width, int height,
+                          int stride, int pixstride, int channels, int engine);
+
+// sdfContextBuildFormat with SDF_FORMAT_FLOAT. Resampling the floats before quantising keeps the full precision.
+int sdfContextBuildFloat(SDFcontext *ctx, float *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                         const unsigned char *img, int width, int height, int stride, int pixstride, int channels, int engine);
+
+// The transform of sdfContextBuildChannels without the remap, to remap an image to other radii without
+// transforming it again. 'dist' gets width * height * (number of selected channels) floats, the selected
+// channels of a pixel next to each other in byte order: the squared distance in pixels to the contour,
+// inside and outside alike. The distances hold for the radii up to 'radius'; with SDF_CONTEXT_NARROW_BAND
+// the pixels further away may get any larger value.
+int sdfContextBuildSquared(SDFcontext *ctx, float *dist, float radius, const unsigned char *img, int width, int height,
+                           int stride, int pixstride, int channels, int engine);
+
+// Maps the squared distances of sdfContextBuildSquared to bytes, as sdfContextBuildChannels does, on the
+// context threads. 'img' and 'channels' are the ones the distances were built from, the image tells the
+// inside from the outside. Both radii must be at most the radius of the build. 'out' may be 'img'.
+int sdfContextRemapSquared(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride,
+                           float outside_radius, float inside_radius, const float *dist, const unsigned char *img,
+                           int width, int height, int stride, int pixstride, int channels);
+
+// Rounds to the nearest IEEE half float, the conversion of SDF_FORMAT_HALF.
+unsigned short sdfFloatToHalf(float value);
+
+// Tiled builds read and write the image through callbacks, one rectangle [x0,x1) x [y0,y1) at a time.
+// 'pixels' holds the rectangle with 'stride' bytes per row and the 'pixstride' given to the build per pixel.
+// The reader fills it, the writer stores it. Return 0 to abort the build.
+typedef int (*SDFtileFunc)(void *user, unsigned char *pixels, int stride, int x0, int y0, int x1, int y1);
+
+// Same as sdfContextBuildChannels with SDF_ENGINE_EXACT, but the image is never held in memory as a
+// whole: it is baked 'tilesize' x 'tilesize' pixels at a time (1024 when 0), each tile read together with
+// a halo of the larger radius plus 3 pixels. The temp memory grows with the tile size only, so images
+// far larger than the memory can be streamed from and to disk. The result is the same as the
+// full image build. The reads of neighbouring tiles overlap, so the writer must not store over the input.
+// Unselected channels are written back as read.
+int sdfContextBuildTiled(SDFcontext *ctx, SDFtileFunc read, SDFtileFunc write, void *user, int width, int height,
+                         int pixstride, int channels, float outside_radius, float inside_radius, int tilesize);
+
+// Called on the build threads as soon as the output rows [y0,y1) of a context build are final, to
+// compress or upload them while the other rows are still being baked. 'thread' is in [0,threads).
+// y0 is a multiple of 16 and the ranges cover the image once, in no particular order. The tiled
+// builds hand their rows to the writer instead.
+typedef void (*SDFrowsFunc)(void *user, int y0, int y1, int thread);
+
+// Sets the callback of the next builds of 'ctx', NULL removes it.
+void sdfContextSetRowsCallback(SDFcontext *ctx, SDFrowsFunc rows, void *user);
+
+// Runs 'task' once for every index in [0,count) on the context threads, the calling thread included,
+// and returns when all of them are done. 'thread' is in [0,threads). Lets the caller split its own work
+// around the builds without starting more threads. Must not be called from a task or a rows callback.
+typedef void (*SDFtaskFunc)(void *user, int index, int thread);
+void sdfContextRun(SDFcontext *ctx, int count, SDFtaskFunc task, void *user);
+
+// Context statistics: the number of build threads, the creation flags, the bytes of temp memory currently
+// held, the most bytes any build needed so far, and how many times the temp memory was (re)allocated.
+int sdfContextThreads(const SDFcontext *ctx);
+int sdfContextFlags(const SDFcontext *ctx);
+size_t sdfContextScratchSize(const SDFcontext *ctx);
+size_t sdfContextPeakScratch(const SDFcontext *ctx);
+int sdfContextAllocations(const SDFcontext *ctx);
+
+// Phases of a build, in the order they run. The 8SSEDT runs the two sweeps, the exact engine its
+// column and row passes instead; the band phase runs with SDF_CONTEXT_NARROW_BAND only.
+enum SDFphase
+{
+    SDF_PHASE_EDGES = 0,          // Temp memory init and gradient pre-pass, fused in one pass over the image.
+    SDF_PHASE_BAND = 1,           // Marking and dilating the narrow band tiles.
+    SDF_PHASE_SWEEP_FORWARD = 2,  // 8SSEDT forward sweep.
+    SDF_PHASE_SWEEP_BACKWARD = 3, // 8SSEDT backward sweep.
+    SDF_PHASE_EXACT = 4,          // The four passes of SDF_ENGINE_EXACT.
+    SDF_PHASE_REMAP = 5,          // Distances to output samples.
+    SDF_PHASE_COVERAGE = 6,       // The whole of sdfContextCoverageToDistanceField(), which has no other phase.
+    SDF_PHASE_COUNT = 7,
+};
+
+typedef struct SDFphaseStats
+{
+    unsigned long long start;  // When the phase first ran, nanoseconds of the steady clock (std::chrono::steady_clock).
+    unsigned long long ns;     // Wall time spent in the phase, all threads together.
+    unsigned long long pixels; // Image pixels the phase went over, the band ones only for the transform.
+    unsigned long long bytes;  // Temp memory the phase read or wrote, estimated from the per pixel state.
+} SDFphaseStats;
+
+// Build statistics. The context builds add to them, so they cover every tile of a tiled build; zero
+// them to start over. Phases that did not run stay zero.
+typedef struct SDFstats
+{
+    SDFphaseStats phases[SDF_PHASE_COUNT];
+    int builds;
+    int passes; // 8SSEDT forward and backward pass pairs, see SDF_ENGINE_8SSEDT_ADAPTIVE.
+} SDFstats;
+
+// Sets the statistics the next builds of 'ctx' add to, NULL (the default) stops timing them.
+void sdfContextSetStats(SDFcontext *ctx, SDFstats *stats);
+
+// Short lower case name of an SDFphase, e.g. "sweep_forward".
+const char *sdfPhaseName(int phase);
+
+// SIMD instruction sets for the edge and remap passes.
+enum SDFsimd
+{
+    SDF_SIMD_NONE = 0, // Plain C, also used when SDF_NO_SIMD is defined or the CPU is not x86-64.
+    SDF_SIMD_SSE2 = 1,
+    SDF_SIMD_AVX2 = 2,
+};
+
+// The builds use the best instruction set the CPU supports, detected at runtime. This limits them
+// to at most 'level' (e.g. to compare against SDF_SIMD_NONE) and returns the level now in use.
+// The SIMD passes match the plain C ones to within 1 in the output bytes.
+int sdfSetSimdLevel(int level);
+
 // This function converts the antialiased image where each pixel represents coverage (box-filter
-// sampling of the ideal, crisp edge) to a distance field with narrow band radius of sqrt(2).
+// sampling of the ideal, crisp edge) to a distance field with narrow band radius of sqrt(2)/2,
+// the bytes are 255 * (0.5 + d / sqrt(2)).
 // This is the fastest way to turn antialised image to contour texture. This function is good
 // if you don't need the distance field for effects (i.e. fat outline or dropshadow).
 // Input and output buffers must be different.
@@ -66,104 +283,81 @@ void sdfBuildDistanceFieldNoAlloc(unsigned char *out, int outstride, float outsi
 void sdfCoverageToDistanceField(unsigned char *out, int outstride,
                                 const unsigned char *img, int width, int height, int stride);
 
+// Same estimate as sdfCoverageToDistanceField, for the 'channels' of an interleaved image as in
+// sdfContextBuildChannels, on the context threads, and mapped to the radii like the builds. Every pixel
+// is done on its own from its 3x3 neighbourhood: the edge pixels get the distance to their own contour
+// point, the others are 0 or 255 as they are. With both radii at most SDF_COVERAGE_RADIUS the builds
+// give the same bytes, but for a few steps on the pixels whose neighbour holds a nearer contour point;
+// with larger radii the field stops short a pixel from the contour.
+// 'out' may be 'img' to bake in place, the selected channels are then copied to the temp memory first.
+// The one pixel border is 0. Returns 0 if the temp memory could not be allocated.
+int sdfContextCoverageToDistanceField(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride,
+                                      float outside_radius, float inside_radius, const unsigned char *img, int width,
+                                      int height, int stride, int pixstride, int channels);
+
+// The pixels sdfContextCoverageToDistanceField leaves flat are at least half a pixel from the contour,
+// up to this radius the builds saturate them too. The bytes of sdfCoverageToDistanceField are at
+// sqrt(2)/2, which only fits the edge pixels.
+#define SDF_COVERAGE_RADIUS 0.5f
+
 #endif // SDF_H
 
 #ifdef SDF_IMPLEMENTATION
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
 
-#define SDF_MAX_PASSES 10    // Maximum number of distance transform passes
+#if !defined(SDF_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define SDF__X86 // SSE2 is always there, AVX2 is checked at runtime.
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SDF__TARGET_AVX2
+#else
+#define SDF__TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#define SDF_MAX_PASSES 10    // Maximum number of passes of SDF_ENGINE_8SSEDT_ADAPTIVE.
 #define SDF_SLACK 0.001f     // Controls how much smaller the neighbour value must be to cosnider, too small slack increse iteration count.
 #define SDF_SQRT2 1.4142136f // sqrt(2)
 #define SDF_BIG 1e+37f       // Big value used to initialize the distance field.
+#define SDF_LINE_BLOCK 16    // Number of columns the exact engine processes together.
+#define SDF_PARALLEL_ROWS 16 // Number of rows handed to a thread at a time.
+#define SDF_BAND_TILE 32     // Side of the square tiles the narrow band is tracked in.
+#define SDF_TILE_SIZE 1024   // Default side of the tiles of sdfContextBuildTiled().
+#define SDF__FORMAT_SQUARED 4 // Output of sdfContextBuildSquared(), the squared distances as they are.
 
-static float sdf__clamp01(float x)
+#ifdef SDF__X86
+// Loads 4 bytes to the low lane of a vector.
+static __m128i sdf__load4(const unsigned char *p)
 {
-    return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+    int v;
+    memcpy(&v, p, 4);
+    return _mm_cvtsi32_si128(v);
 }
+#endif
 
-void sdfCoverageToDistanceField(unsigned char *out, int outstride,
-                                const unsigned char *img, int width, int height, int stride)
+static float sdf__clamp01(float x)
 {
-    int x, y;
-
-    // Zero out borders
-    for (x = 0; x < width; x++)
-        out[x] = 0;
-    for (y = 1; y < height; y++)
-    {
-        out[y * outstride] = 0;
-        out[width - 1 + y * outstride] = 0;
-    }
-    for (x = 0; x < width; x++)
-        out[x + (height - 1) * outstride] = 0;
-
-    for (y = 1; y < height - 1; y++)
-    {
-        for (x = 1; x < width - 1; x++)
-        {
-            int k = x + y * stride;
-            float d, gx, gy, glen, a, a1;
-
-            // Skip flat areas.
-            if (img[k] == 255)
-            {
-                out[x + y * outstride] = 255;
-                continue;
-            }
-            if (img[k] == 0)
-            {
-                // Special handling for cases where full opaque pixels are next to full transparent pixels.
-                // See: https://github.com/memononen/SDF/issues/2
-                int he = img[k - 1] == 255 || img[k + 1] == 255;
-                int ve = img[k - stride] == 255 || img[k + stride] == 255;
-                if (!he && !ve)
-                {
-                    out[x + y * outstride] = 0;
-                    continue;
-                }
-            }
-
-            gx = -(float)img[k - stride - 1] - SDF_SQRT2 * (float)img[k - 1] - (float)img[k + stride - 1] + (float)img[k - stride + 1] + SDF_SQRT2 * (float)img[k + 1] + (float)img[k + stride + 1];
-            gy = -(float)img[k - stride - 1] - SDF_SQRT2 * (float)img[k - stride] - (float)img[k - stride + 1] + (float)img[k + stride - 1] + SDF_SQRT2 * (float)img[k + stride] + (float)img[k + stride + 1];
-            a = (float)img[k] / 255.0f;
-            gx = fabsf(gx);
-            gy = fabsf(gy);
-            if (gx < 0.0001f || gy < 0.000f)
-            {
-                d = (0.5f - a) * SDF_SQRT2;
-            }
-            else
-            {
-                glen = gx * gx + gy * gy;
-                glen = 1.0f / sqrtf(glen);
-                gx *= glen;
-                gy *= glen;
-                if (gx < gy)
-                {
-                    float temp = gx;
-                    gx = gy;
-                    gy = temp;
-                }
-                a1 = 0.5f * gy / gx;
-                if (a < a1)
-                { // 0 <= a < a1
-                    d = 0.5f * (gx + gy) - sqrtf(2.0f * gx * gy * a);
-                }
-                else if (a < (1.0 - a1))
-                { // a1 <= a <= 1-a1
-                    d = (0.5f - a) * gx;
-                }
-                else
-                { // 1-a1 < a <= 1
-                    d = -0.5f * (gx + gy) + sqrt(2.0f * gx * gy * (1.0f - a));
-                }
-            }
-            d *= 1.0f / SDF_SQRT2;
-            out[x + y * outstride] = (unsigned char)(sdf__clamp01(0.5f - d) * 255.0f);
-        }
-    }
+    return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
 }
 
 static float sdf__edgedf(float gx, float gy, float a)
@@ -210,183 +404,2312 @@ struct SDFpoint
     float x, y;
 };
 
-static float sdf__distsqr(struct SDFpoint *a, struct SDFpoint *b)
+#ifndef SDF_COMPACT_SCRATCH
+static float sdf__distsqr(const struct SDFpoint *a, const struct SDFpoint *b)
 {
     float dx = b->x - a->x, dy = b->y - a->y;
     return dx * dx + dy * dy;
 }
+#endif
+
+#ifdef SDF_COMPACT_SCRATCH
+
+// Nearest contour point as an offset from the pixel, in 1/SDF_COMPACT_UNIT pixels. Offsets only move
+// by whole pixels during the sweep, so they stay exact; points further than 32767/SDF_COMPACT_UNIT
+// pixels are dropped, which is fine as long as the radius is below that.
+struct SDFseed
+{
+    short dx, dy;
+};
+typedef int SDFdist; // Squared distance in 1/SDF_COMPACT_UNIT^2 pixels.
+
+#define SDF_COMPACT_UNIT 32  // Subpixel steps of the compact seed offsets.
+#define SDF_NO_SEED (-32768) // dx of pixels without a contour point.
+#define SDF_DIST_FAR 0x7fffffff
+
+static void sdf__seedClear(struct SDFseed *seed, SDFdist *dist)
+{
+    seed->dx = seed->dy = SDF_NO_SEED;
+    *dist = SDF_DIST_FAR;
+}
+
+static void sdf__seedSet(struct SDFseed *seed, SDFdist *dist, int x, int y, float px, float py)
+{
+    int dx = (int)lrintf((px - x) * SDF_COMPACT_UNIT), dy = (int)lrintf((py - y) * SDF_COMPACT_UNIT);
+    seed->dx = (short)dx;
+    seed->dy = (short)dy;
+    *dist = dx * dx + dy * dy;
+}
+
+static int sdf__seedValid(const struct SDFseed *seed)
+{
+    return seed->dx != SDF_NO_SEED;
+}
+
+static struct SDFpoint sdf__seedPoint(const struct SDFseed *seed, int x, int y)
+{
+    struct SDFpoint p = {x + seed->dx * (1.0f / SDF_COMPACT_UNIT), y + seed->dy * (1.0f / SDF_COMPACT_UNIT)};
+    return p;
+}
+
+static float sdf__distToFloat(SDFdist d)
+{
+    return d * (1.0f / (SDF_COMPACT_UNIT * SDF_COMPACT_UNIT));
+}
 
-void UpdatePoint(SDFpoint *tpt, float *tdist, int x, int y, int oX, int oY, int width)
+static SDFdist sdf__distFromFloat(float d)
 {
-    int k = x + y * width, kn, ch = 0;
-    struct SDFpoint c = {(float)x, (float)y};
-    float pd = tdist[k], d;
-    kn = k + oX + oY * width;
-    if (tdist[kn] < pd)
+    d *= SDF_COMPACT_UNIT * SDF_COMPACT_UNIT;
+    return d < (float)SDF_DIST_FAR ? (SDFdist)d : SDF_DIST_FAR;
+}
+
+// Takes the contour point of the neighbour at offset (oX,oY) in, if it is nearer, checking the
+// neighbour distance first like the float version. Returns the updated distance.
+static SDFdist sdf__take(struct SDFseed *seed, SDFdist pd, const struct SDFseed *nseed, SDFdist nd, int x, int y, int oX, int oY)
+{
+    int dx = nseed->dx + oX * SDF_COMPACT_UNIT, dy = nseed->dy + oY * SDF_COMPACT_UNIT, d;
+    (void)x;
+    (void)y;
+    if (nd >= pd || dx < -32767 || dx > 32767 || dy < -32767 || dy > 32767)
+        return pd;
+    d = dx * dx + dy * dy;
+    if (d < pd)
     {
-        d = sdf__distsqr(&c, &tpt[kn]);
-        if (d < pd)
-        {
-            tpt[k] = tpt[kn];
-            tdist[k] = d;
-        }
+        seed->dx = (short)dx;
+        seed->dy = (short)dy;
+        return d;
     }
+    return pd;
 }
 
-void sdfBuildDistanceFieldNoAlloc(unsigned char *out, int outstride, float outside_radius, float inside_radius,
-                                  const unsigned char *img, int width, int height, int stride,
-                                  unsigned char *temp)
+// sdf__take() from the pixels at (-1,-1), (0,-1) and (1,-1) in turn, without branches.
+// 'above' and 'dabove' point at the pixel above, channels are 'nc' elements apart.
+static void sdf__takeAbove(struct SDFseed *seed, SDFdist *dist, const struct SDFseed *above, const SDFdist *dabove,
+                           int nc, int x, int y)
 {
-    int i, x, y, pass;
-    float *tdist = (float *)&temp[0];
-    struct SDFpoint *tpt = (struct SDFpoint *)&temp[width * height * sizeof(float)];
+    SDFdist pd = *dist;
+    int sx = seed->dx, sy = seed->dy, o;
+    (void)x;
+    (void)y;
+    for (o = -1; o <= 1; o++)
+    {
+        int dx = above[o * nc].dx + o * SDF_COMPACT_UNIT, dy = above[o * nc].dy - SDF_COMPACT_UNIT;
+        unsigned int d = (unsigned int)(dx * dx) + (unsigned int)(dy * dy);
+        int take = (dabove[o * nc] < pd) & (dx >= -32767) & (dx <= 32767) & (dy >= -32767) & (d < (unsigned int)pd);
+        pd = take ? (SDFdist)d : pd;
+        sx = take ? dx : sx;
+        sy = take ? dy : sy;
+    }
+    seed->dx = (short)sx;
+    seed->dy = (short)sy;
+    *dist = pd;
+}
 
-    // Initialize buffers
-    for (y = 0; y < height; y++)
+#else
+
+// Nearest contour point in image coordinates, x < 0 marks pixels without one.
+struct SDFseed
+{
+    float x, y;
+};
+typedef float SDFdist;
+
+static void sdf__seedClear(struct SDFseed *seed, SDFdist *dist)
+{
+    seed->x = -1;
+    seed->y = -1;
+    *dist = SDF_BIG;
+}
+
+static void sdf__seedSet(struct SDFseed *seed, SDFdist *dist, int x, int y, float px, float py)
+{
+    struct SDFpoint c = {(float)x, (float)y}, p = {px, py};
+    seed->x = px;
+    seed->y = py;
+    *dist = sdf__distsqr(&c, &p);
+}
+
+static int sdf__seedValid(const struct SDFseed *seed)
+{
+    return seed->x >= 0.0f;
+}
+
+static struct SDFpoint sdf__seedPoint(const struct SDFseed *seed, int x, int y)
+{
+    struct SDFpoint p = {seed->x, seed->y};
+    (void)x;
+    (void)y;
+    return p;
+}
+
+static float sdf__distToFloat(SDFdist d)
+{
+    return d;
+}
+
+static SDFdist sdf__distFromFloat(float d)
+{
+    return d;
+}
+
+static SDFdist sdf__take(struct SDFseed *seed, SDFdist pd, const struct SDFseed *nseed, SDFdist nd, int x, int y, int oX, int oY)
+{
+    struct SDFpoint c = {(float)x, (float)y}, p = {nseed->x, nseed->y};
+    float d;
+    (void)oX;
+    (void)oY;
+    if (nd >= pd)
+        return pd;
+    d = sdf__distsqr(&c, &p);
+    if (d < pd)
     {
-        for (x = 0; x < width; x++)
-        {
-            int k = x + y * width;
-            tpt[k].x = 0;
-            tpt[k].y = 0;
-            tdist[k] = SDF_BIG;
-        }
+        *seed = *nseed;
+        return d;
+    }
+    return pd;
+}
+
+static void sdf__takeAbove(struct SDFseed *seed, SDFdist *dist, const struct SDFseed *above, const SDFdist *dabove,
+                           int nc, int x, int y)
+{
+    SDFdist pd = *dist;
+    float sx = seed->x, sy = seed->y;
+    int o;
+    for (o = -1; o <= 1; o++)
+    {
+        float nx = above[o * nc].x, ny = above[o * nc].y;
+        float dx = nx - (float)x, dy = ny - (float)y, d = dx * dx + dy * dy;
+        int take = (dabove[o * nc] < pd) & (d < pd);
+        pd = take ? d : pd;
+        sx = take ? nx : sx;
+        sy = take ? ny : sy;
     }
+    seed->x = sx;
+    seed->y = sy;
+    *dist = pd;
+}
 
-    // Calculate position of the anti-aliased pixels and distance to the boundary of the shape.
-	for (y = 1; y < height-1; y++) {
-		for (x = 1; x < width-1; x++) {
-			int tk, k = x + y * stride;
-			struct SDFpoint c = { (float)x, (float)y };
-			float d, gx, gy, glen;
-
-			// Skip flat areas.
-			if (img[k] == 255) continue;
-			if (img[k] == 0) {
-				// Special handling for cases where full opaque pixels are next to full transparent pixels.
-				// See: https://github.com/memononen/SDF/issues/2
-				int he = img[k-1] == 255 || img[k+1] == 255;
-				int ve = img[k-stride] == 255 || img[k+stride] == 255;
-				if (!he && !ve) continue;
-			}
-
-			// Calculate gradient direction
-			gx = -(float)img[k-stride-1] - SDF_SQRT2*(float)img[k-1] - (float)img[k+stride-1] + (float)img[k-stride+1] + SDF_SQRT2*(float)img[k+1] + (float)img[k+stride+1];
-			gy = -(float)img[k-stride-1] - SDF_SQRT2*(float)img[k-stride] - (float)img[k-stride+1] + (float)img[k+stride-1] + SDF_SQRT2*(float)img[k+stride] + (float)img[k+stride+1];
-			if (fabsf(gx) < 0.001f && fabsf(gy) < 0.001f) continue;
-			glen = gx*gx + gy*gy;
-			if (glen > 0.0001f) {
-				glen = 1.0f / sqrtf(glen);
-				gx *= glen;
-				gy *= glen;
-			}
-
-			// Find nearest point on contour.
-			tk = x + y * width;
-			d = sdf__edgedf(gx, gy, (float)img[k]/255.0f);
-			tpt[tk].x = x + gx*d;
-			tpt[tk].y = y + gy*d;
-			tdist[tk] = sdf__distsqr(&c, &tpt[tk]);
+#endif // SDF_COMPACT_SCRATCH
+
+// Updates all 'nc' interleaved channels of the pixel from its neighbour at offset (oX,oY).
+void UpdatePoint(struct SDFseed *tpt, SDFdist *tdist, int x, int y, int oX, int oY, int width, int nc)
+{
+    int k = (x + y * width) * nc, kn, ch;
+    kn = k + (oX + oY * width) * nc;
+    for (ch = 0; ch < nc; ch++, k++, kn++)
+        tdist[k] = sdf__take(&tpt[k], tdist[k], &tpt[kn], tdist[kn], x, y, oX, oY);
+}
+
+// Contour points of the pixels [x0,x1) of row 'y'. 'row' holds the input pixels of the row, 'up' and 'down'
+// the rows above and below, one byte per pixel. The results are written every 'nc' elements of tpt and tdist.
+// The points are placed at (x + ox, y), so that a window of a larger image gets the coordinates, and
+// the rounding, of the whole image.
+static void sdf__edgeRowScalar(struct SDFseed *tpt, SDFdist *tdist, const unsigned char *up, const unsigned char *row,
+                               const unsigned char *down, int x0, int x1, int y, int ox, int nc)
+{
+	int x;
+	for (x = x0; x < x1; x++) {
+		float d, gx, gy, glen;
+
+		// Skip flat areas.
+		if (row[x] == 255) continue;
+		if (row[x] == 0) {
+			// Special handling for cases where full opaque pixels are next to full transparent pixels.
+			// See: https://github.com/memononen/SDF/issues/2
+			int he = row[x-1] == 255 || row[x+1] == 255;
+			int ve = up[x] == 255 || down[x] == 255;
+			if (!he && !ve) continue;
 		}
+
+		// Calculate gradient direction
+		gx = -(float)up[x-1] - SDF_SQRT2*(float)row[x-1] - (float)down[x-1] + (float)up[x+1] + SDF_SQRT2*(float)row[x+1] + (float)down[x+1];
+		gy = -(float)up[x-1] - SDF_SQRT2*(float)up[x] - (float)up[x+1] + (float)down[x-1] + SDF_SQRT2*(float)down[x] + (float)down[x+1];
+		if (fabsf(gx) < 0.001f && fabsf(gy) < 0.001f) continue;
+		glen = gx*gx + gy*gy;
+		if (glen > 0.0001f) {
+			glen = 1.0f / sqrtf(glen);
+			gx *= glen;
+			gy *= glen;
+		}
+
+		// Find nearest point on contour.
+		d = sdf__edgedf(gx, gy, (float)row[x]/255.0f);
+		sdf__seedSet(&tpt[x * nc], &tdist[x * nc], x + ox, y, x + ox + gx*d, y + gy*d);
 	}
+}
 
-    // 8SSEDT
+// Maps 'n' squared distances to bytes, 'in' holds the matching input pixels.
+static void sdf__remapRowScalar(unsigned char *out, const float *dist, const unsigned char *in, int n,
+                                float outside_scale, float inside_scale)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        float dout = sqrtf(dist[i]) * outside_scale;
+        float din = sqrtf(dist[i]) * inside_scale;
+        float alpha = in[i] > 127 ? din * 0.5f + 0.5f : (1.0f - dout) * 0.5f;
+        out[i] = (unsigned char)(sdf__clamp01(alpha + 0.5f / 255) * 255.0f);
+    }
+}
 
-    // Bottom-left to top-right.
-    for (y = 1; y < height - 1; y++)
+// Coverage estimate of the pixels [x0,x1) of a row, see sdfContextCoverageToDistanceField(). 'up', 'row'
+// and 'down' are as for the edge rows; 'out' gets one byte per pixel, mapped like sdf__remapRowScalar().
+// Only the pixels the edge pass gives a contour point get a distance, the others keep their byte.
+static void sdf__coverageRowScalar(unsigned char *out, const unsigned char *up, const unsigned char *row,
+                                   const unsigned char *down, int x0, int x1, float outside_scale, float inside_scale)
+{
+    int x;
+    for (x = x0; x < x1; x++)
     {
-        // |P.
-        // |XX
+        float d, gx, gy, glen;
+
+        if (row[x] == 255 || (row[x] == 0 && row[x - 1] != 255 && row[x + 1] != 255 && up[x] != 255 && down[x] != 255))
         {
-            UpdatePoint(tpt, tdist, 0, y, 0, -1, width);
-            UpdatePoint(tpt, tdist, 0, y, 1, -1, width);
+            out[x] = row[x];
+            continue;
         }
 
-        // -->
-        // XP.
-        // XXX
-        for (x = 1; x < width - 1; x++)
+        gx = -(float)up[x-1] - SDF_SQRT2*(float)row[x-1] - (float)down[x-1] + (float)up[x+1] + SDF_SQRT2*(float)row[x+1] + (float)down[x+1];
+        gy = -(float)up[x-1] - SDF_SQRT2*(float)up[x] - (float)up[x+1] + (float)down[x-1] + SDF_SQRT2*(float)down[x] + (float)down[x+1];
+        if (fabsf(gx) < 0.001f && fabsf(gy) < 0.001f)
         {
-            UpdatePoint(tpt, tdist, x, y, -1, -1, width);
-            UpdatePoint(tpt, tdist, x, y, 0, -1, width);
-            UpdatePoint(tpt, tdist, x, y, 1, -1, width);
-            UpdatePoint(tpt, tdist, x, y, -1, 0, width);
+            out[x] = row[x];
+            continue;
+        }
+        glen = gx*gx + gy*gy;
+        if (glen > 0.0001f) {
+            glen = 1.0f / sqrtf(glen);
+            gx *= glen;
+            gy *= glen;
         }
 
-        // XP|
-        // XX|
+        // Positive outside the shape.
+        d = sdf__edgedf(gx, gy, (float)row[x]/255.0f);
+        d = d > 0.0f ? 0.5f - 0.5f * d * outside_scale : 0.5f - 0.5f * d * inside_scale;
+        out[x] = (unsigned char)(sdf__clamp01(d + 0.5f / 255) * 255.0f);
+    }
+}
+
+#ifdef SDF__X86
+
+// The SIMD versions below evaluate the same expressions as the scalar ones in the same order,
+// one pixel per lane, and hand the remaining pixels of a row to the scalar version.
+
+static void sdf__edgeRowSSE2(struct SDFseed *tpt, SDFdist *tdist, const unsigned char *up, const unsigned char *row,
+                             const unsigned char *down, int x0, int x1, int y, int ox, int nc)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 sign = _mm_set1_ps(-0.0f), half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f);
+    const __m128 sqrt2 = _mm_set1_ps(SDF_SQRT2), full = _mm_set1_ps(255.0f), none = _mm_setzero_ps();
+    float px[4], py[4];
+    int x, i, mask, flat = 0;
+
+#define SDF__LOAD4(p) _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(sdf__load4(p), zero), zero))
+    for (x = x0; x + 4 <= x1; x += 4)
+    {
+        // Most of the image is flat, test 16 pixels at a time on the bytes first.
+        if (((x - x0) & 15) == 0)
         {
-            UpdatePoint(tpt, tdist, width - 1, y, -1, -1, width);
-            UpdatePoint(tpt, tdist, width - 1, y, 0, -1, width);
-            UpdatePoint(tpt, tdist, width - 1, y, -1, 0, width);
+            flat = 0;
+            if (x + 16 <= x1)
+            {
+                const __m128i ones = _mm_set1_epi8((char)0xff);
+                __m128i cb = _mm_loadu_si128((const __m128i *)(row + x));
+                __m128i nb = _mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + x - 1)), ones),
+                                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + x + 1)), ones));
+                nb = _mm_or_si128(nb, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up + x)), ones));
+                nb = _mm_or_si128(nb, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down + x)), ones));
+                nb = _mm_andnot_si128(_mm_cmpeq_epi8(cb, ones), _mm_or_si128(nb, _mm_xor_si128(_mm_cmpeq_epi8(cb, zero), ones)));
+                flat = ~_mm_movemask_epi8(nb) & 0xffff;
+            }
         }
+        if (((flat >> ((x - x0) & 15)) & 15) == 15)
+            continue;
 
-        // <--
-        // .PX
-        for (x = width - 2; x >= 0; x--)
+        __m128 c = SDF__LOAD4(row + x), l = SDF__LOAD4(row + x - 1), r = SDF__LOAD4(row + x + 1);
+        __m128 u = SDF__LOAD4(up + x), ul = SDF__LOAD4(up + x - 1), ur = SDF__LOAD4(up + x + 1);
+        __m128 dn = SDF__LOAD4(down + x), dl = SDF__LOAD4(down + x - 1), dr = SDF__LOAD4(down + x + 1);
+        __m128 act, gx, gy, glen, a, zx, hx, hy, a1, s, d1, d2, d3, df, fx;
+
+        // Skip flat areas, zero pixels count only next to a full one.
+        act = _mm_or_ps(_mm_cmpeq_ps(l, full), _mm_cmpeq_ps(r, full));
+        act = _mm_or_ps(act, _mm_or_ps(_mm_cmpeq_ps(u, full), _mm_cmpeq_ps(dn, full)));
+        act = _mm_and_ps(_mm_cmpneq_ps(c, full), _mm_or_ps(_mm_cmpneq_ps(c, none), act));
+        if (_mm_movemask_ps(act) == 0)
+            continue;
+
+        gx = _mm_sub_ps(_mm_sub_ps(_mm_xor_ps(ul, sign), _mm_mul_ps(sqrt2, l)), dl);
+        gx = _mm_add_ps(_mm_add_ps(_mm_add_ps(gx, ur), _mm_mul_ps(sqrt2, r)), dr);
+        gy = _mm_sub_ps(_mm_sub_ps(_mm_xor_ps(ul, sign), _mm_mul_ps(sqrt2, u)), ur);
+        gy = _mm_add_ps(_mm_add_ps(_mm_add_ps(gy, dl), _mm_mul_ps(sqrt2, dn)), dr);
+        act = _mm_andnot_ps(_mm_and_ps(_mm_cmplt_ps(_mm_andnot_ps(sign, gx), _mm_set1_ps(0.001f)),
+                                       _mm_cmplt_ps(_mm_andnot_ps(sign, gy), _mm_set1_ps(0.001f))), act);
+        mask = _mm_movemask_ps(act);
+        if (mask == 0)
+            continue;
+        glen = _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy));
+        s = _mm_cmpgt_ps(glen, _mm_set1_ps(0.0001f));
+        glen = _mm_div_ps(one, _mm_sqrt_ps(glen));
+        gx = _mm_or_ps(_mm_and_ps(s, _mm_mul_ps(gx, glen)), _mm_andnot_ps(s, gx));
+        gy = _mm_or_ps(_mm_and_ps(s, _mm_mul_ps(gy, glen)), _mm_andnot_ps(s, gy));
+
+        // sdf__edgedf() for all lanes, the branches become selects.
+        a = _mm_div_ps(c, full);
+        zx = _mm_or_ps(_mm_cmpeq_ps(gx, none), _mm_cmpeq_ps(gy, none));
+        hx = _mm_max_ps(_mm_andnot_ps(sign, gx), _mm_andnot_ps(sign, gy));
+        hy = _mm_min_ps(_mm_andnot_ps(sign, gx), _mm_andnot_ps(sign, gy));
+        a1 = _mm_div_ps(_mm_mul_ps(half, hy), hx);
+        s = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), hx), hy);
+        d1 = _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(hx, hy)), _mm_sqrt_ps(_mm_mul_ps(s, a)));
+        d2 = _mm_mul_ps(_mm_sub_ps(half, a), hx);
+        d3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.5f), _mm_add_ps(hx, hy)), _mm_sqrt_ps(_mm_mul_ps(s, _mm_sub_ps(one, a))));
+        s = _mm_cmplt_ps(a, _mm_sub_ps(one, a1));
+        df = _mm_or_ps(_mm_and_ps(s, d2), _mm_andnot_ps(s, d3));
+        s = _mm_cmplt_ps(a, a1);
+        df = _mm_or_ps(_mm_and_ps(s, d1), _mm_andnot_ps(s, df));
+        df = _mm_or_ps(_mm_and_ps(zx, _mm_sub_ps(half, a)), _mm_andnot_ps(zx, df));
+
+        fx = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x + ox), _mm_set_epi32(3, 2, 1, 0)));
+        _mm_storeu_ps(px, _mm_add_ps(fx, _mm_mul_ps(gx, df)));
+        _mm_storeu_ps(py, _mm_add_ps(_mm_set1_ps((float)y), _mm_mul_ps(gy, df)));
+        for (i = 0; i < 4; i++)
         {
-            UpdatePoint(tpt, tdist, x, y, 1, 0, width);
+            if (mask & (1 << i))
+            {
+                sdf__seedSet(&tpt[(x + i) * nc], &tdist[(x + i) * nc], x + i + ox, y, px[i], py[i]);
+            }
         }
     }
+#undef SDF__LOAD4
+    sdf__edgeRowScalar(tpt, tdist, up, row, down, x, x1, y, ox, nc);
+}
 
-    // Top-right to bottom-left.
-    for (y = height - 2; y > 0; y--)
+static void sdf__remapRowSSE2(unsigned char *out, const float *dist, const unsigned char *in, int n,
+                              float outside_scale, float inside_scale)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f), bias = _mm_set1_ps(0.5f / 255);
+    int i;
+    for (i = 0; i + 4 <= n; i += 4)
     {
-        // XX|
-        // .P|
+        __m128 d = _mm_sqrt_ps(_mm_loadu_ps(dist + i));
+        __m128i inside = _mm_cmpgt_epi32(_mm_unpacklo_epi16(_mm_unpacklo_epi8(sdf__load4(in + i), zero), zero), _mm_set1_epi32(127));
+        __m128 din = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(d, _mm_set1_ps(inside_scale)), half), half);
+        __m128 dout = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(d, _mm_set1_ps(outside_scale))), half);
+        __m128 alpha = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(inside), din), _mm_andnot_ps(_mm_castsi128_ps(inside), dout));
+        __m128i b;
+        int v;
+        alpha = _mm_min_ps(_mm_max_ps(_mm_add_ps(alpha, bias), _mm_setzero_ps()), one);
+        b = _mm_cvttps_epi32(_mm_mul_ps(alpha, _mm_set1_ps(255.0f)));
+        b = _mm_packus_epi16(_mm_packs_epi32(b, zero), zero);
+        v = _mm_cvtsi128_si32(b);
+        memcpy(out + i, &v, 4);
+    }
+    sdf__remapRowScalar(out + i, dist + i, in + i, n - i, outside_scale, inside_scale);
+}
+
+static void sdf__coverageRowSSE2(unsigned char *out, const unsigned char *up, const unsigned char *row,
+                                 const unsigned char *down, int x0, int x1, float outside_scale, float inside_scale)
+{
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi8((char)0xff);
+    const __m128 sign = _mm_set1_ps(-0.0f), half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f);
+    const __m128 sqrt2 = _mm_set1_ps(SDF_SQRT2), full = _mm_set1_ps(255.0f), none = _mm_setzero_ps();
+    const __m128 oscale = _mm_set1_ps(0.5f * outside_scale), iscale = _mm_set1_ps(0.5f * inside_scale);
+    int x, i, v;
+
+#define SDF__LOAD4(p) _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(sdf__load4(p), zero), zero))
+    for (x = x0; x + 16 <= x1; x += 16)
+    {
+        // Most of the image is flat and stays as it is, test 16 pixels at a time on the bytes first.
+        __m128i cb = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i nb = _mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + x - 1)), ones),
+                                  _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + x + 1)), ones));
+        nb = _mm_or_si128(nb, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up + x)), ones));
+        nb = _mm_or_si128(nb, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down + x)), ones));
+        nb = _mm_andnot_si128(_mm_cmpeq_epi8(cb, ones), _mm_or_si128(nb, _mm_xor_si128(_mm_cmpeq_epi8(cb, zero), ones)));
+        if (_mm_movemask_epi8(nb) == 0)
         {
-            UpdatePoint(tpt, tdist, width - 1, y, 0, 1, width);
-            UpdatePoint(tpt, tdist, width - 1, y, -1, 1, width);
+            _mm_storeu_si128((__m128i *)(out + x), cb);
+            continue;
         }
-        // <--
-        // XXX
-        // .PX
-        for (x = width - 2; x > 0; x--)
+
+        for (i = x; i < x + 16; i += 4)
         {
-            UpdatePoint(tpt, tdist, x, y, 1, 0, width);
-            UpdatePoint(tpt, tdist, x, y, -1, 1, width);
-            UpdatePoint(tpt, tdist, x, y, 0, 1, width);
-            UpdatePoint(tpt, tdist, x, y, 1, 1, width);
+            __m128 c = SDF__LOAD4(row + i), l = SDF__LOAD4(row + i - 1), r = SDF__LOAD4(row + i + 1);
+            __m128 u = SDF__LOAD4(up + i), ul = SDF__LOAD4(up + i - 1), ur = SDF__LOAD4(up + i + 1);
+            __m128 dn = SDF__LOAD4(down + i), dl = SDF__LOAD4(down + i - 1), dr = SDF__LOAD4(down + i + 1);
+            __m128 act, gx, gy, glen, a, zx, hx, hy, a1, s, d1, d2, d3, df, alpha;
+            __m128i b;
+
+            act = _mm_or_ps(_mm_cmpeq_ps(l, full), _mm_cmpeq_ps(r, full));
+            act = _mm_or_ps(act, _mm_or_ps(_mm_cmpeq_ps(u, full), _mm_cmpeq_ps(dn, full)));
+            act = _mm_and_ps(_mm_cmpneq_ps(c, full), _mm_or_ps(_mm_cmpneq_ps(c, none), act));
+
+            gx = _mm_sub_ps(_mm_sub_ps(_mm_xor_ps(ul, sign), _mm_mul_ps(sqrt2, l)), dl);
+            gx = _mm_add_ps(_mm_add_ps(_mm_add_ps(gx, ur), _mm_mul_ps(sqrt2, r)), dr);
+            gy = _mm_sub_ps(_mm_sub_ps(_mm_xor_ps(ul, sign), _mm_mul_ps(sqrt2, u)), ur);
+            gy = _mm_add_ps(_mm_add_ps(_mm_add_ps(gy, dl), _mm_mul_ps(sqrt2, dn)), dr);
+            act = _mm_andnot_ps(_mm_and_ps(_mm_cmplt_ps(_mm_andnot_ps(sign, gx), _mm_set1_ps(0.001f)),
+                                           _mm_cmplt_ps(_mm_andnot_ps(sign, gy), _mm_set1_ps(0.001f))), act);
+            glen = _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy));
+            s = _mm_cmpgt_ps(glen, _mm_set1_ps(0.0001f));
+            glen = _mm_div_ps(one, _mm_sqrt_ps(glen));
+            gx = _mm_or_ps(_mm_and_ps(s, _mm_mul_ps(gx, glen)), _mm_andnot_ps(s, gx));
+            gy = _mm_or_ps(_mm_and_ps(s, _mm_mul_ps(gy, glen)), _mm_andnot_ps(s, gy));
+
+            a = _mm_div_ps(c, full);
+            zx = _mm_or_ps(_mm_cmpeq_ps(gx, none), _mm_cmpeq_ps(gy, none));
+            hx = _mm_max_ps(_mm_andnot_ps(sign, gx), _mm_andnot_ps(sign, gy));
+            hy = _mm_min_ps(_mm_andnot_ps(sign, gx), _mm_andnot_ps(sign, gy));
+            a1 = _mm_div_ps(_mm_mul_ps(half, hy), hx);
+            s = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), hx), hy);
+            d1 = _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(hx, hy)), _mm_sqrt_ps(_mm_mul_ps(s, a)));
+            d2 = _mm_mul_ps(_mm_sub_ps(half, a), hx);
+            d3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.5f), _mm_add_ps(hx, hy)), _mm_sqrt_ps(_mm_mul_ps(s, _mm_sub_ps(one, a))));
+            s = _mm_cmplt_ps(a, _mm_sub_ps(one, a1));
+            df = _mm_or_ps(_mm_and_ps(s, d2), _mm_andnot_ps(s, d3));
+            s = _mm_cmplt_ps(a, a1);
+            df = _mm_or_ps(_mm_and_ps(s, d1), _mm_andnot_ps(s, df));
+            df = _mm_or_ps(_mm_and_ps(zx, _mm_sub_ps(half, a)), _mm_andnot_ps(zx, df));
+
+            // Mapped as in the remap, the flat lanes keep their byte.
+            s = _mm_cmpgt_ps(df, none);
+            alpha = _mm_sub_ps(half, _mm_mul_ps(df, _mm_or_ps(_mm_and_ps(s, oscale), _mm_andnot_ps(s, iscale))));
+            alpha = _mm_min_ps(_mm_max_ps(_mm_add_ps(alpha, _mm_set1_ps(0.5f / 255)), none), one);
+            alpha = _mm_or_ps(_mm_and_ps(act, _mm_mul_ps(alpha, full)), _mm_andnot_ps(act, c));
+            b = _mm_cvttps_epi32(alpha);
+            b = _mm_packus_epi16(_mm_packs_epi32(b, zero), zero);
+            v = _mm_cvtsi128_si32(b);
+            memcpy(out + i, &v, 4);
         }
-        // |XX
-        // |PX
+    }
+#undef SDF__LOAD4
+    sdf__coverageRowScalar(out, up, row, down, x, x1, outside_scale, inside_scale);
+}
+
+SDF__TARGET_AVX2 static void sdf__edgeRowAVX2(struct SDFseed *tpt, SDFdist *tdist, const unsigned char *up, const unsigned char *row,
+                                              const unsigned char *down, int x0, int x1, int y, int ox, int nc)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f), half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.0f);
+    const __m256 sqrt2 = _mm256_set1_ps(SDF_SQRT2), full = _mm256_set1_ps(255.0f), none = _mm256_setzero_ps();
+    float px[8], py[8];
+    int x, i, mask;
+    unsigned int flat = 0;
+
+#define SDF__LOAD8(p) _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p))))
+    for (x = x0; x + 8 <= x1; x += 8)
+    {
+        // Most of the image is flat, test 32 pixels at a time on the bytes first.
+        if (((x - x0) & 31) == 0)
         {
-            UpdatePoint(tpt, tdist, 0, y, 0, 1, width);
-            UpdatePoint(tpt, tdist, 0, y, 1, 1, width);
-            UpdatePoint(tpt, tdist, 0, y, 1, 0, width);
+            flat = 0;
+            if (x + 32 <= x1)
+            {
+                const __m256i ones = _mm256_set1_epi8((char)0xff);
+                __m256i cb = _mm256_loadu_si256((const __m256i *)(row + x));
+                __m256i nb = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(row + x - 1)), ones),
+                                             _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(row + x + 1)), ones));
+                nb = _mm256_or_si256(nb, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up + x)), ones));
+                nb = _mm256_or_si256(nb, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down + x)), ones));
+                nb = _mm256_andnot_si256(_mm256_cmpeq_epi8(cb, ones),
+                                         _mm256_or_si256(nb, _mm256_xor_si256(_mm256_cmpeq_epi8(cb, _mm256_setzero_si256()), ones)));
+                flat = ~(unsigned int)_mm256_movemask_epi8(nb);
+            }
         }
-        // -->
-        // XP.
-        for (x = 1; x < width; x++)
+        if (((flat >> ((x - x0) & 31)) & 255) == 255)
+            continue;
+
+        __m256 c = SDF__LOAD8(row + x), l = SDF__LOAD8(row + x - 1), r = SDF__LOAD8(row + x + 1);
+        __m256 u = SDF__LOAD8(up + x), ul = SDF__LOAD8(up + x - 1), ur = SDF__LOAD8(up + x + 1);
+        __m256 dn = SDF__LOAD8(down + x), dl = SDF__LOAD8(down + x - 1), dr = SDF__LOAD8(down + x + 1);
+        __m256 act, gx, gy, glen, a, zx, hx, hy, a1, s, d1, d2, d3, df, fx;
+
+        // Skip flat areas, zero pixels count only next to a full one.
+        act = _mm256_or_ps(_mm256_cmp_ps(l, full, _CMP_EQ_OQ), _mm256_cmp_ps(r, full, _CMP_EQ_OQ));
+        act = _mm256_or_ps(act, _mm256_or_ps(_mm256_cmp_ps(u, full, _CMP_EQ_OQ), _mm256_cmp_ps(dn, full, _CMP_EQ_OQ)));
+        act = _mm256_and_ps(_mm256_cmp_ps(c, full, _CMP_NEQ_OQ), _mm256_or_ps(_mm256_cmp_ps(c, none, _CMP_NEQ_OQ), act));
+        if (_mm256_movemask_ps(act) == 0)
+            continue;
+
+        gx = _mm256_sub_ps(_mm256_sub_ps(_mm256_xor_ps(ul, sign), _mm256_mul_ps(sqrt2, l)), dl);
+        gx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(gx, ur), _mm256_mul_ps(sqrt2, r)), dr);
+        gy = _mm256_sub_ps(_mm256_sub_ps(_mm256_xor_ps(ul, sign), _mm256_mul_ps(sqrt2, u)), ur);
+        gy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(gy, dl), _mm256_mul_ps(sqrt2, dn)), dr);
+        act = _mm256_andnot_ps(_mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, gx), _mm256_set1_ps(0.001f), _CMP_LT_OQ),
+                                             _mm256_cmp_ps(_mm256_andnot_ps(sign, gy), _mm256_set1_ps(0.001f), _CMP_LT_OQ)), act);
+        mask = _mm256_movemask_ps(act);
+        if (mask == 0)
+            continue;
+        glen = _mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy));
+        s = _mm256_cmp_ps(glen, _mm256_set1_ps(0.0001f), _CMP_GT_OQ);
+        glen = _mm256_div_ps(one, _mm256_sqrt_ps(glen));
+        gx = _mm256_blendv_ps(gx, _mm256_mul_ps(gx, glen), s);
+        gy = _mm256_blendv_ps(gy, _mm256_mul_ps(gy, glen), s);
+
+        // sdf__edgedf() for all lanes, the branches become selects.
+        a = _mm256_div_ps(c, full);
+        zx = _mm256_or_ps(_mm256_cmp_ps(gx, none, _CMP_EQ_OQ), _mm256_cmp_ps(gy, none, _CMP_EQ_OQ));
+        hx = _mm256_max_ps(_mm256_andnot_ps(sign, gx), _mm256_andnot_ps(sign, gy));
+        hy = _mm256_min_ps(_mm256_andnot_ps(sign, gx), _mm256_andnot_ps(sign, gy));
+        a1 = _mm256_div_ps(_mm256_mul_ps(half, hy), hx);
+        s = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), hx), hy);
+        d1 = _mm256_sub_ps(_mm256_mul_ps(half, _mm256_add_ps(hx, hy)), _mm256_sqrt_ps(_mm256_mul_ps(s, a)));
+        d2 = _mm256_mul_ps(_mm256_sub_ps(half, a), hx);
+        d3 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-0.5f), _mm256_add_ps(hx, hy)), _mm256_sqrt_ps(_mm256_mul_ps(s, _mm256_sub_ps(one, a))));
+        df = _mm256_blendv_ps(d3, d2, _mm256_cmp_ps(a, _mm256_sub_ps(one, a1), _CMP_LT_OQ));
+        df = _mm256_blendv_ps(df, d1, _mm256_cmp_ps(a, a1, _CMP_LT_OQ));
+        df = _mm256_blendv_ps(df, _mm256_sub_ps(half, a), zx);
+
+        fx = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x + ox), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0)));
+        _mm256_storeu_ps(px, _mm256_add_ps(fx, _mm256_mul_ps(gx, df)));
+        _mm256_storeu_ps(py, _mm256_add_ps(_mm256_set1_ps((float)y), _mm256_mul_ps(gy, df)));
+        for (i = 0; i < 8; i++)
         {
-            UpdatePoint(tpt, tdist, x, y, -1, 0, width);
+            if (mask & (1 << i))
+            {
+                sdf__seedSet(&tpt[(x + i) * nc], &tdist[(x + i) * nc], x + i + ox, y, px[i], py[i]);
+            }
         }
     }
+#undef SDF__LOAD8
+    sdf__edgeRowScalar(tpt, tdist, up, row, down, x, x1, y, ox, nc);
+}
 
-    // Map to good range.
-    float outside_scale = 1.0f / outside_radius;
-    float inside_scale = 1.0f / inside_radius;
-    for (y = 0; y < height; y++)
+SDF__TARGET_AVX2 static void sdf__remapRowAVX2(unsigned char *out, const float *dist, const unsigned char *in, int n,
+                                               float outside_scale, float inside_scale)
+{
+    const __m256 half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.0f), bias = _mm256_set1_ps(0.5f / 255);
+    int i;
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256 d = _mm256_sqrt_ps(_mm256_loadu_ps(dist + i));
+        __m256i inside = _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + i))), _mm256_set1_epi32(127));
+        __m256 din = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(d, _mm256_set1_ps(inside_scale)), half), half);
+        __m256 dout = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(d, _mm256_set1_ps(outside_scale))), half);
+        __m256 alpha = _mm256_blendv_ps(dout, din, _mm256_castsi256_ps(inside));
+        __m256i b;
+        __m128i p;
+        alpha = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(alpha, bias), _mm256_setzero_ps()), one);
+        b = _mm256_cvttps_epi32(_mm256_mul_ps(alpha, _mm256_set1_ps(255.0f)));
+        p = _mm_packs_epi32(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1));
+        _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(p, p));
+    }
+    sdf__remapRowScalar(out + i, dist + i, in + i, n - i, outside_scale, inside_scale);
+}
+
+SDF__TARGET_AVX2 static void sdf__coverageRowAVX2(unsigned char *out, const unsigned char *up, const unsigned char *row,
+                                                  const unsigned char *down, int x0, int x1, float outside_scale, float inside_scale)
+{
+    const __m256i ones = _mm256_set1_epi8((char)0xff);
+    const __m256 sign = _mm256_set1_ps(-0.0f), half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.0f);
+    const __m256 sqrt2 = _mm256_set1_ps(SDF_SQRT2), full = _mm256_set1_ps(255.0f), none = _mm256_setzero_ps();
+    const __m256 oscale = _mm256_set1_ps(0.5f * outside_scale), iscale = _mm256_set1_ps(0.5f * inside_scale);
+    int x, i;
+
+#define SDF__LOAD8(p) _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p))))
+    for (x = x0; x + 32 <= x1; x += 32)
     {
-        for (x = 0; x < width; x++)
+        // Most of the image is flat and stays as it is, test 32 pixels at a time on the bytes first.
+        __m256i cb = _mm256_loadu_si256((const __m256i *)(row + x));
+        __m256i nb = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(row + x - 1)), ones),
+                                     _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(row + x + 1)), ones));
+        nb = _mm256_or_si256(nb, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up + x)), ones));
+        nb = _mm256_or_si256(nb, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down + x)), ones));
+        nb = _mm256_andnot_si256(_mm256_cmpeq_epi8(cb, ones),
+                                 _mm256_or_si256(nb, _mm256_xor_si256(_mm256_cmpeq_epi8(cb, _mm256_setzero_si256()), ones)));
+        if (_mm256_movemask_epi8(nb) == 0)
+        {
+            _mm256_storeu_si256((__m256i *)(out + x), cb);
+            continue;
+        }
+
+        for (i = x; i < x + 32; i += 8)
         {
-            float dout = sqrtf(tdist[x + y * width]) * outside_scale;
-            float din = sqrtf(tdist[x + y * width]) * inside_scale;
-            float alpha = img[x + y * stride] > 127 ? din * 0.5f + 0.5f : (1.0f - dout) * 0.5f;
-            out[x + y * outstride] = (unsigned char)(sdf__clamp01(alpha + 0.5f / 255) * 255.0f);
+            __m256 c = SDF__LOAD8(row + i), l = SDF__LOAD8(row + i - 1), r = SDF__LOAD8(row + i + 1);
+            __m256 u = SDF__LOAD8(up + i), ul = SDF__LOAD8(up + i - 1), ur = SDF__LOAD8(up + i + 1);
+            __m256 dn = SDF__LOAD8(down + i), dl = SDF__LOAD8(down + i - 1), dr = SDF__LOAD8(down + i + 1);
+            __m256 act, gx, gy, glen, a, zx, hx, hy, a1, s, d1, d2, d3, df, alpha;
+            __m256i b;
+            __m128i p;
+
+            act = _mm256_or_ps(_mm256_cmp_ps(l, full, _CMP_EQ_OQ), _mm256_cmp_ps(r, full, _CMP_EQ_OQ));
+            act = _mm256_or_ps(act, _mm256_or_ps(_mm256_cmp_ps(u, full, _CMP_EQ_OQ), _mm256_cmp_ps(dn, full, _CMP_EQ_OQ)));
+            act = _mm256_and_ps(_mm256_cmp_ps(c, full, _CMP_NEQ_OQ), _mm256_or_ps(_mm256_cmp_ps(c, none, _CMP_NEQ_OQ), act));
+
+            gx = _mm256_sub_ps(_mm256_sub_ps(_mm256_xor_ps(ul, sign), _mm256_mul_ps(sqrt2, l)), dl);
+            gx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(gx, ur), _mm256_mul_ps(sqrt2, r)), dr);
+            gy = _mm256_sub_ps(_mm256_sub_ps(_mm256_xor_ps(ul, sign), _mm256_mul_ps(sqrt2, u)), ur);
+            gy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(gy, dl), _mm256_mul_ps(sqrt2, dn)), dr);
+            act = _mm256_andnot_ps(_mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, gx), _mm256_set1_ps(0.001f), _CMP_LT_OQ),
+                                                 _mm256_cmp_ps(_mm256_andnot_ps(sign, gy), _mm256_set1_ps(0.001f), _CMP_LT_OQ)), act);
+            glen = _mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy));
+            s = _mm256_cmp_ps(glen, _mm256_set1_ps(0.0001f), _CMP_GT_OQ);
+            glen = _mm256_div_ps(one, _mm256_sqrt_ps(glen));
+            gx = _mm256_blendv_ps(gx, _mm256_mul_ps(gx, glen), s);
+            gy = _mm256_blendv_ps(gy, _mm256_mul_ps(gy, glen), s);
+
+            a = _mm256_div_ps(c, full);
+            zx = _mm256_or_ps(_mm256_cmp_ps(gx, none, _CMP_EQ_OQ), _mm256_cmp_ps(gy, none, _CMP_EQ_OQ));
+            hx = _mm256_max_ps(_mm256_andnot_ps(sign, gx), _mm256_andnot_ps(sign, gy));
+            hy = _mm256_min_ps(_mm256_andnot_ps(sign, gx), _mm256_andnot_ps(sign, gy));
+            a1 = _mm256_div_ps(_mm256_mul_ps(half, hy), hx);
+            s = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), hx), hy);
+            d1 = _mm256_sub_ps(_mm256_mul_ps(half, _mm256_add_ps(hx, hy)), _mm256_sqrt_ps(_mm256_mul_ps(s, a)));
+            d2 = _mm256_mul_ps(_mm256_sub_ps(half, a), hx);
+            d3 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-0.5f), _mm256_add_ps(hx, hy)), _mm256_sqrt_ps(_mm256_mul_ps(s, _mm256_sub_ps(one, a))));
+            df = _mm256_blendv_ps(d3, d2, _mm256_cmp_ps(a, _mm256_sub_ps(one, a1), _CMP_LT_OQ));
+            df = _mm256_blendv_ps(df, d1, _mm256_cmp_ps(a, a1, _CMP_LT_OQ));
+            df = _mm256_blendv_ps(df, _mm256_sub_ps(half, a), zx);
+
+            // Mapped as in the remap, the flat lanes keep their byte.
+            alpha = _mm256_sub_ps(half, _mm256_mul_ps(df, _mm256_blendv_ps(iscale, oscale, _mm256_cmp_ps(df, none, _CMP_GT_OQ))));
+            alpha = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(alpha, _mm256_set1_ps(0.5f / 255)), none), one);
+            alpha = _mm256_blendv_ps(c, _mm256_mul_ps(alpha, full), act);
+            b = _mm256_cvttps_epi32(alpha);
+            p = _mm_packs_epi32(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1));
+            _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(p, p));
         }
     }
+#undef SDF__LOAD8
+    sdf__coverageRowScalar(out, up, row, down, x, x1, outside_scale, inside_scale);
 }
 
-int sdfBuildDistanceField(unsigned char *out, int outstride, float outside_radius, float inside_radius,
-                          const unsigned char *img, int width, int height, int stride)
+#endif // SDF__X86
+
+static int sdf__detectSimd(void)
 {
-    unsigned char *temp = (unsigned char *)malloc(width * height * sizeof(float) * 3);
-    if (temp == NULL)
-        return 0;
-    sdfBuildDistanceFieldNoAlloc(out, outstride, outside_radius, inside_radius, img, width, height, stride, temp);
+#if !defined(SDF__X86)
+    return SDF_SIMD_NONE;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    // AVX2 needs the OS to save the ymm registers too.
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        return SDF_SIMD_SSE2;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) ? SDF_SIMD_AVX2 : SDF_SIMD_SSE2;
+#else
+    return __builtin_cpu_supports("avx2") ? SDF_SIMD_AVX2 : SDF_SIMD_SSE2;
+#endif
+}
+
+static std::atomic<int> sdf__simdLimit(SDF_SIMD_AVX2);
+
+static int sdf__simdLevel(void)
+{
+    static const int detected = sdf__detectSimd();
+    int limit = sdf__simdLimit.load(std::memory_order_relaxed);
+    return detected < limit ? detected : limit;
+}
+
+int sdfSetSimdLevel(int level)
+{
+    sdf__simdLimit.store(level < SDF_SIMD_NONE ? SDF_SIMD_NONE : level, std::memory_order_relaxed);
+    return sdf__simdLevel();
+}
+
+typedef void (*SDFedgeRowFunc)(struct SDFseed *tpt, SDFdist *tdist, const unsigned char *up, const unsigned char *row,
+                               const unsigned char *down, int x0, int x1, int y, int ox, int nc);
+typedef void (*SDFremapRowFunc)(unsigned char *out, const float *dist, const unsigned char *in, int n,
+                                float outside_scale, float inside_scale);
+typedef void (*SDFcoverageRowFunc)(unsigned char *out, const unsigned char *up, const unsigned char *row,
+                                   const unsigned char *down, int x0, int x1, float outside_scale, float inside_scale);
+
+static SDFedgeRowFunc sdf__edgeRowFunc(void)
+{
+#ifdef SDF__X86
+    switch (sdf__simdLevel())
+    {
+    case SDF_SIMD_AVX2:
+        return sdf__edgeRowAVX2;
+    case SDF_SIMD_SSE2:
+        return sdf__edgeRowSSE2;
+    }
+#endif
+    return sdf__edgeRowScalar;
+}
+
+static SDFremapRowFunc sdf__remapRowFunc(void)
+{
+#ifdef SDF__X86
+    switch (sdf__simdLevel())
+    {
+    case SDF_SIMD_AVX2:
+        return sdf__remapRowAVX2;
+    case SDF_SIMD_SSE2:
+        return sdf__remapRowSSE2;
+    }
+#endif
+    return sdf__remapRowScalar;
+}
+
+static SDFcoverageRowFunc sdf__coverageRowFunc(void)
+{
+#ifdef SDF__X86
+    switch (sdf__simdLevel())
+    {
+    case SDF_SIMD_AVX2:
+        return sdf__coverageRowAVX2;
+    case SDF_SIMD_SSE2:
+        return sdf__coverageRowSSE2;
+    }
+#endif
+    return sdf__coverageRowScalar;
+}
+
+// Copies 'width' bytes 'pixstride' apart into 'dst'.
+static void sdf__gatherRow(unsigned char *dst, const unsigned char *src, int width, int pixstride)
+{
+    int x;
+    for (x = 0; x < width; x++)
+        dst[x] = src[x * pixstride];
+}
+
+// Finds the contour points of the rows [y0,y1). Input pixels are 'pixstride' bytes apart, and the
+// 'nc' channels are read at the byte offsets 'coff' of each pixel. Channels of interleaved images
+// are first gathered into three rolling rows in 'linetemp' (3 * width bytes), so that the row kernels
+// always see contiguous pixels. The image is a window at (ox,oy) of a larger one, (0,0) for the whole image.
+static void sdf__findEdges(struct SDFseed *tpt, SDFdist *tdist, const unsigned char *img, int width, int height, int stride,
+                           int pixstride, const int *coff, int nc, int ox, int oy, int y0, int y1, unsigned char *linetemp)
+{
+    SDFedgeRowFunc edgeRow = sdf__edgeRowFunc();
+    int x, y, ch;
+
+    // Initialize buffers
+    for (y = y0; y < y1; y++)
+    {
+        for (x = 0; x < width * nc; x++)
+        {
+            int k = x + y * width * nc;
+            sdf__seedClear(&tpt[k], &tdist[k]);
+        }
+    }
+
+    // Calculate position of the anti-aliased pixels and distance to the boundary of the shape.
+    for (ch = 0; ch < nc; ch++)
+    {
+        const unsigned char *src = img + coff[ch];
+        int last = -1, r;
+        for (y = y0 > 1 ? y0 : 1; y < y1 && y < height - 1; y++)
+        {
+            const unsigned char *rows[3];
+            for (r = 0; r < 3; r++)
+            {
+                int ry = y - 1 + r;
+                if (pixstride == 1)
+                {
+                    rows[r] = src + ry * stride;
+                    continue;
+                }
+                rows[r] = linetemp + (ry % 3) * width;
+                if (ry > last)
+                    sdf__gatherRow(linetemp + (ry % 3) * width, src + ry * stride, width, pixstride);
+            }
+            last = y + 1;
+            edgeRow(tpt + (size_t)y * width * nc + ch, tdist + (size_t)y * width * nc + ch, rows[0], rows[1], rows[2],
+                    1, width - 1, y + oy, ox, nc);
+        }
+    }
+}
+
+// Takes in the three pixels above for the pixels [x0,x1) of row y, in the order of the UpdatePoint()
+// calls (-1,-1), (0,-1), (1,-1). The pixels of the row don't depend on each other, and sdf__takeAbove()
+// is written with selects only, so that the compiler can vectorize the loop.
+static void sdf__sweepAbove(struct SDFseed *tpt, SDFdist *tdist, int y, int x0, int x1, int width, int nc)
+{
+    struct SDFseed *row = tpt + (size_t)y * width * nc;
+    SDFdist *drow = tdist + (size_t)y * width * nc;
+    size_t up = (size_t)width * nc;
+    int x, ch;
+
+    if (nc == 1)
+    {
+        for (x = x0; x < x1; x++)
+            sdf__takeAbove(&row[x], &drow[x], &row[x] - up, &drow[x] - up, 1, x, y);
+        return;
+    }
+    for (x = x0; x < x1; x++)
+    {
+        for (ch = 0; ch < nc; ch++)
+            sdf__takeAbove(&row[x * nc + ch], &drow[x * nc + ch], &row[x * nc + ch] - up, &drow[x * nc + ch] - up, nc, x, y);
+    }
+}
+
+// Narrow band helpers. The band is a byte per SDF_BAND_TILE x SDF_BAND_TILE tile of the image, set for
+// the tiles that may hold pixels within the radius of a contour point; the others are known to be
+// saturated and are skipped by the transform.
+static int sdf__bandTiles(int len)
+{
+    return (len + SDF_BAND_TILE - 1) / SDF_BAND_TILE;
+}
+
+static size_t sdf__bandTempSize(int width, int height)
+{
+    // The band and the half dilated band.
+    return ((size_t)sdf__bandTiles(width) * sdf__bandTiles(height) * 2 + 63) & ~(size_t)63;
+}
+
+// Finds the next run of band tiles along a line of 'len' pixels, starting at pixel *pos. 'band' points to
+// the first tile of the line and successive tiles are 'bstep' bytes apart. The run is returned as the
+// pixels [*a,*b) and *pos is moved past it. Without a band, the whole line is a single run.
+static int sdf__bandSpan(const unsigned char *band, int bstep, int len, int *pos, int *a, int *b)
+{
+    int t = *pos / SDF_BAND_TILE, tiles = sdf__bandTiles(len);
+    if (*pos >= len)
+        return 0;
+    if (band == NULL)
+    {
+        *a = *pos;
+        *b = *pos = len;
+        return *a < len;
+    }
+    while (t < tiles && !band[t * bstep])
+        t++;
+    if (t >= tiles)
+        return 0;
+    *a = t * SDF_BAND_TILE;
+    while (t < tiles && band[t * bstep])
+        t++;
+    *b = *pos = t * SDF_BAND_TILE < len ? t * SDF_BAND_TILE : len;
+    return 1;
+}
+
+// Sets the band tiles of the tile rows [ty0,ty1) that hold a contour point.
+static void sdf__bandMark(const struct SDFseed *tpt, int width, int height, int nc, unsigned char *band, int ty0, int ty1)
+{
+    int tilesx = sdf__bandTiles(width), x, y, ty;
+    for (ty = ty0; ty < ty1; ty++)
+    {
+        unsigned char *brow = band + (size_t)ty * tilesx;
+        int y1 = (ty + 1) * SDF_BAND_TILE < height ? (ty + 1) * SDF_BAND_TILE : height;
+        memset(brow, 0, tilesx);
+        for (y = ty * SDF_BAND_TILE; y < y1; y++)
+        {
+            const struct SDFseed *row = tpt + (size_t)y * width * nc;
+            for (x = 0; x < width * nc; x++)
+            {
+                if (sdf__seedValid(&row[x]))
+                    brow[x / nc / SDF_BAND_TILE] = 1;
+            }
+        }
+    }
+}
+
+// Grows the marked tiles by 'r' tiles in every direction, 'tmp' holds the horizontal half.
+static void sdf__bandDilate(unsigned char *band, unsigned char *tmp, int width, int height, int r)
+{
+    int tilesx = sdf__bandTiles(width), tilesy = sdf__bandTiles(height), tx, ty, i;
+    for (ty = 0; ty < tilesy; ty++)
+    {
+        const unsigned char *src = band + (size_t)ty * tilesx;
+        unsigned char *dst = tmp + (size_t)ty * tilesx;
+        for (tx = 0; tx < tilesx; tx++)
+        {
+            unsigned char v = 0;
+            for (i = tx - r < 0 ? 0 : tx - r; i <= tx + r && i < tilesx && !v; i++)
+                v = src[i];
+            dst[tx] = v;
+        }
+    }
+    for (ty = 0; ty < tilesy; ty++)
+    {
+        for (tx = 0; tx < tilesx; tx++)
+        {
+            unsigned char v = 0;
+            for (i = ty - r < 0 ? 0 : ty - r; i <= ty + r && i < tilesy && !v; i++)
+                v = tmp[(size_t)i * tilesx + tx];
+            band[(size_t)ty * tilesx + tx] = v;
+        }
+    }
+}
+
+// 8SSEDT over the whole image, or over the runs of 'band' tiles of each row when a band is given. The
+// pixels around a run are outside the band and hold no contour point, so reading them changes nothing.
+// The forward sweep goes bottom-left to top-right, row by row, sdf__sweepBackward() comes back.
+static void sdf__sweepForwardRow(struct SDFseed *tpt, SDFdist *tdist, int y, int width, int nc, const unsigned char *band)
+{
+    const unsigned char *brow = band != NULL ? band + (size_t)(y / SDF_BAND_TILE) * sdf__bandTiles(width) : NULL;
+    int x, pos, a, b, xa, xb;
+
+    for (pos = 0; sdf__bandSpan(brow, 1, width, &pos, &a, &b);)
+    {
+        xa = a > 1 ? a : 1;
+        xb = b < width - 1 ? b : width - 1;
+
+        // |P.
+        // |XX
+        if (a == 0)
+        {
+            UpdatePoint(tpt, tdist, 0, y, 0, -1, width, nc);
+            UpdatePoint(tpt, tdist, 0, y, 1, -1, width, nc);
+        }
+
+        // -->
+        // XP.
+        // XXX
+        // The row above is final, so it is taken in first for the whole run, then the left neighbours.
+        // Every pixel still sees the same updates in the same order.
+        sdf__sweepAbove(tpt, tdist, y, xa, xb, width, nc);
+        for (x = xa; x < xb; x++)
+        {
+            UpdatePoint(tpt, tdist, x, y, -1, 0, width, nc);
+        }
+
+        // XP|
+        // XX|
+        if (b == width)
+        {
+            UpdatePoint(tpt, tdist, width - 1, y, -1, -1, width, nc);
+            UpdatePoint(tpt, tdist, width - 1, y, 0, -1, width, nc);
+            UpdatePoint(tpt, tdist, width - 1, y, -1, 0, width, nc);
+        }
+
+        // <--
+        // .PX
+        for (x = xb - 1; x >= a; x--)
+        {
+            UpdatePoint(tpt, tdist, x, y, 1, 0, width, nc);
+        }
+    }
+}
+
+static void sdf__sweepForward(struct SDFseed *tpt, SDFdist *tdist, int width, int height, int nc, const unsigned char *band)
+{
+    int y;
+    for (y = 1; y < height - 1; y++)
+        sdf__sweepForwardRow(tpt, tdist, y, width, nc, band);
+}
+
+// Top-right to bottom-left half.
+static void sdf__sweepBackwardRow(struct SDFseed *tpt, SDFdist *tdist, int y, int width, int nc, const unsigned char *band)
+{
+    const unsigned char *brow = band != NULL ? band + (size_t)(y / SDF_BAND_TILE) * sdf__bandTiles(width) : NULL;
+    int x, pos, a, b, xa, xb;
+
+    for (pos = 0; sdf__bandSpan(brow, 1, width, &pos, &a, &b);)
+    {
+        xa = a > 1 ? a : 1;
+        xb = b < width - 1 ? b : width - 1;
+
+        // XX|
+        // .P|
+        if (b == width)
+        {
+            UpdatePoint(tpt, tdist, width - 1, y, 0, 1, width, nc);
+            UpdatePoint(tpt, tdist, width - 1, y, -1, 1, width, nc);
+        }
+        // <--
+        // XXX
+        // .PX
+        for (x = xb - 1; x >= xa; x--)
+        {
+            UpdatePoint(tpt, tdist, x, y, 1, 0, width, nc);
+            UpdatePoint(tpt, tdist, x, y, -1, 1, width, nc);
+            UpdatePoint(tpt, tdist, x, y, 0, 1, width, nc);
+            UpdatePoint(tpt, tdist, x, y, 1, 1, width, nc);
+        }
+        // |XX
+        // |PX
+        if (a == 0)
+        {
+            UpdatePoint(tpt, tdist, 0, y, 0, 1, width, nc);
+            UpdatePoint(tpt, tdist, 0, y, 1, 1, width, nc);
+            UpdatePoint(tpt, tdist, 0, y, 1, 0, width, nc);
+        }
+        // -->
+        // XP.
+        for (x = xa; x < b; x++)
+        {
+            UpdatePoint(tpt, tdist, x, y, -1, 0, width, nc);
+        }
+    }
+}
+
+static void sdf__sweepBackward(struct SDFseed *tpt, SDFdist *tdist, int width, int height, int nc, const unsigned char *band)
+{
+    int y;
+    for (y = height - 2; y > 0; y--)
+        sdf__sweepBackwardRow(tpt, tdist, y, width, nc, band);
+}
+
+// Lower envelope of the parabolas (t - c[i])^2 + f[i] for t in [0,len), Felzenszwalb-Huttenlocher.
+// 'g' holds f[i] + c[i]^2. The centres are sorted first, they come in nearly sorted so the insertion
+// sort is linear in practice. On return best[t] holds the index (after sorting) of the lowest parabola
+// at t0 + t, n must be > 0.
+static void sdf__envelope(float *c, double *g, int *id, int n, int t0, int len, int *best, int *v, double *zn, double *zd)
+{
+    int i, j, k, t;
+
+    for (i = 1; i < n; i++)
+    {
+        float ci;
+        double gi;
+        int idi;
+        if (c[i - 1] <= c[i])
+            continue;
+        ci = c[i];
+        gi = g[i];
+        idi = id[i];
+        for (j = i; j > 0 && c[j - 1] > ci; j--)
+        {
+            c[j] = c[j - 1];
+            g[j] = g[j - 1];
+            id[j] = id[j - 1];
+        }
+        c[j] = ci;
+        g[j] = gi;
+        id[j] = idi;
+    }
+
+    // The envelope boundaries are kept as fractions zn/zd (zd > 0) to keep the divisions out of the loop.
+    k = 0;
+    v[0] = 0;
+    zn[0] = -SDF_BIG;
+    zd[0] = 1.0;
+    for (i = 1; i < n; i++)
+    {
+        double sn = 0.0, sd = 1.0;
+        if (c[i] == c[v[k]])
+        {
+            // Same centre, keep the lower one.
+            if (g[i] >= g[v[k]])
+                continue;
+            if (k == 0)
+            {
+                v[0] = i;
+                continue;
+            }
+            k--;
+        }
+        while (k >= 0)
+        {
+            sn = g[i] - g[v[k]];
+            sd = 2.0 * ((double)c[i] - c[v[k]]);
+            if (sn * zd[k] > zn[k] * sd)
+                break;
+            k--;
+        }
+        k++;
+        v[k] = i;
+        zn[k] = k == 0 ? -SDF_BIG : sn;
+        zd[k] = k == 0 ? 1.0 : sd;
+    }
+
+    j = k;
+    k = 0;
+    for (t = 0; t < len; t++)
+    {
+        while (k < j && zn[k + 1] < (double)(t0 + t) * zd[k + 1])
+            k++;
+        best[t] = v[k];
+    }
+}
+
+// Scratch for sdf__exactPass(), 'len' is the longer image side.
+static size_t sdf__lineTempSize(int len)
+{
+    size_t size = (size_t)(len + 1) * ((sizeof(float) + sizeof(double) + sizeof(int) * 2) * SDF_LINE_BLOCK + sizeof(int) + sizeof(double) * 2);
+    return (size + 63) & ~(size_t)63; // Keeps the doubles aligned and the threads off each other's cache lines.
+}
+
+// Exact engine, one pass over the lines [l0,l1). A line is a column when 'cols' is set, a row otherwise.
+// The first pass of each order picks, for every pixel of the line, the nearest contour point found on
+// the line itself and stores its position along the line in 'tsel'.
+// The second pass finds for every pixel the nearest of the points picked across the lines by the
+// first pass, and keeps the smaller of that and the current distance in 'tdist'.
+// Each of the 'nc' interleaved channels of a line is a separate envelope. The lines and their channels
+// are handled SDF_LINE_BLOCK envelopes at a time so that the memory is always walked along the rows.
+// With a 'band', only the pixels of its tiles are gathered and scattered. The lines of a block are kept
+// within one column of tiles, so that all of them see the same runs.
+// The parabolas are placed in the coordinates of the whole image, the window origin is (ox,oy).
+static void sdf__exactPass(const struct SDFseed *tpt, SDFdist *tdist, int *tsel, int width, int height, int nc, int ox, int oy,
+                           int cols, int second, int l0, int l1, const unsigned char *band, unsigned char *linetemp)
+{
+    int len = cols ? height : width;
+    int oalong = cols ? oy : ox, oacross = cols ? ox : oy;
+    int step = cols ? width : 1;
+    int across = cols ? 1 : width;
+    int block = cols ? SDF_LINE_BLOCK / nc : 1;
+    double *g = (double *)&linetemp[0];
+    double *zn = g + (size_t)(len + 1) * SDF_LINE_BLOCK;
+    double *zd = zn + (len + 1);
+    float *c = (float *)(zd + (len + 1));
+    int *id = (int *)(c + (size_t)(len + 1) * SDF_LINE_BLOCK);
+    int *best = id + (size_t)(len + 1) * SDF_LINE_BLOCK;
+    int *v = best + (size_t)(len + 1) * SDF_LINE_BLOCK;
+    int n[SDF_LINE_BLOCK], ch[SDF_LINE_BLOCK];
+    float fl[SDF_LINE_BLOCK];
+    int tilesx = sdf__bandTiles(width), bstep = cols ? tilesx : 1;
+    int l, ln, b, bn, t, pos, ta, tb;
+
+    for (l = l0; l < l1; l += ln)
+    {
+        const unsigned char *bline = NULL;
+        ln = l1 - l < block ? l1 - l : block;
+        if (band != NULL)
+        {
+            if (cols && ln > SDF_BAND_TILE - l % SDF_BAND_TILE)
+                ln = SDF_BAND_TILE - l % SDF_BAND_TILE;
+            bline = band + (size_t)(l / SDF_BAND_TILE) * (cols ? 1 : tilesx);
+        }
+
+        // Envelope b is channel b % nc of line l + b / nc, which puts the envelopes of a block
+        // next to each other in memory: pixel t of envelope b is at (l * across + t * step) * nc + b.
+        bn = ln * nc;
+        for (b = 0; b < bn; b++)
+        {
+            n[b] = 0;
+            ch[b] = b % nc;
+            fl[b] = (float)(oacross + l + b / nc);
+        }
+
+        // Gather the parabolas of every envelope in the block.
+        for (pos = 0; sdf__bandSpan(bline, bstep, len, &pos, &ta, &tb);)
+        {
+            for (t = ta; t < tb; t++)
+            {
+                int base = (l * across + t * step) * nc;
+                for (b = 0; b < bn; b++)
+                {
+                    int k = base + b, s, sl, o = b * (len + 1) + n[b];
+                    struct SDFpoint p;
+                    double d;
+                    if (!second)
+                    {
+                        if (!sdf__seedValid(&tpt[k]))
+                            continue;
+                        s = k;
+                        sl = l + b / nc;
+                    }
+                    else
+                    {
+                        if (tsel[k] < 0)
+                            continue;
+                        s = (cols ? tsel[k] + t * width : t + tsel[k] * width) * nc + ch[b];
+                        sl = tsel[k];
+                    }
+                    // Seed pixel 's' is at 't' along the lines and 'sl' across them.
+                    p = cols ? sdf__seedPoint(&tpt[s], ox + sl, oy + t) : sdf__seedPoint(&tpt[s], ox + t, oy + sl);
+                    c[o] = cols ? p.y : p.x;
+                    d = (double)(cols ? p.x : p.y) - fl[b];
+                    g[o] = d * d + (double)c[o] * c[o];
+                    id[o] = t;
+                    n[b]++;
+                }
+            }
+        }
+
+        for (b = 0; b < bn; b++)
+        {
+            int o = b * (len + 1);
+            if (n[b] > 0)
+                sdf__envelope(&c[o], &g[o], &id[o], n[b], oalong, len, &best[o], v, zn, zd);
+        }
+
+        // Scatter the results.
+        for (pos = 0; sdf__bandSpan(bline, bstep, len, &pos, &ta, &tb);)
+        {
+            for (t = ta; t < tb; t++)
+            {
+                int base = (l * across + t * step) * nc;
+                for (b = 0; b < bn; b++)
+                {
+                    int k = base + b, o = b * (len + 1) + t;
+                    if (!second)
+                    {
+                        tsel[k] = n[b] > 0 ? id[b * (len + 1) + best[o]] : -1;
+                    }
+                    else if (n[b] > 0)
+                    {
+                        // Distance straight from the parabola, (t - c)^2 + f.
+                        int i = b * (len + 1) + best[o];
+                        double dt = (double)(oalong + t) - c[i];
+                        SDFdist d = sdf__distFromFloat((float)(dt * dt + (g[i] - (double)c[i] * c[i])));
+                        if (d < tdist[k])
+                            tdist[k] = d;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Maps the distances of the rows [y0,y1) to bytes, for the 'nc' channels at the byte offsets 'coff'.
+// Unless the selected channels fill the pixels, they are gathered to and scattered from 'linetemp'
+// (2 * width * nc bytes), so that the row kernel always works on contiguous elements. The compact
+// integer distances are converted to floats in place, the row is not needed afterwards.
+// Pixels outside the 'band' tiles are saturated, 255 inside the shape and 0 outside.
+static void sdf__remap(unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                       SDFdist *tdist, const unsigned char *img, int width, int stride, int pixstride,
+                       const int *coff, int nc, int y0, int y1, const unsigned char *band, unsigned char *linetemp)
+{
+    SDFremapRowFunc remapRow = sdf__remapRowFunc();
+    int x, y, ch, packed = 1, n = width * nc;
+    int tilesx = sdf__bandTiles(width), pos, a, b, i;
+    const unsigned char *brow;
+
+    // Map to good range.
+    float outside_scale = 1.0f / outside_radius;
+    float inside_scale = 1.0f / inside_radius;
+    for (ch = 0; ch < nc; ch++)
+        packed &= coff[ch] == ch;
+    for (y = y0; y < y1; y++)
+    {
+        const unsigned char *in = img + y * stride;
+        unsigned char *dst = out + y * outstride;
+        if (!packed || pixstride != nc)
+        {
+            for (x = 0; x < width; x++)
+                for (ch = 0; ch < nc; ch++)
+                    linetemp[x * nc + ch] = img[x * pixstride + y * stride + coff[ch]];
+            in = linetemp;
+        }
+        if (!packed || outpixstride != nc)
+            dst = linetemp + n;
+        brow = band != NULL ? band + (size_t)(y / SDF_BAND_TILE) * tilesx : NULL;
+        for (pos = 0, x = 0;; x = b)
+        {
+            int more = sdf__bandSpan(brow, 1, width, &pos, &a, &b);
+            for (i = x * nc; i < (more ? a : width) * nc; i++)
+                dst[i] = in[i] > 127 ? 255 : 0;
+            if (!more)
+                break;
+#ifdef SDF_COMPACT_SCRATCH
+            for (i = a * nc; i < b * nc; i++)
+            {
+                float d = sdf__distToFloat(tdist[(size_t)y * n + i]);
+                memcpy(tdist + (size_t)y * n + i, &d, sizeof(float));
+            }
+            remapRow(dst + a * nc, (const float *)(tdist + (size_t)y * n + a * nc), in + a * nc, (b - a) * nc,
+                     outside_scale, inside_scale);
+#else
+            remapRow(dst + a * nc, tdist + (size_t)y * n + a * nc, in + a * nc, (b - a) * nc, outside_scale, inside_scale);
+#endif
+        }
+        if (dst != out + y * outstride)
+        {
+            for (x = 0; x < width; x++)
+                for (ch = 0; ch < nc; ch++)
+                    out[x * outpixstride + y * outstride + coff[ch]] = dst[x * nc + ch];
+        }
+    }
+}
+
+unsigned short sdfFloatToHalf(float value)
+{
+    // The exponent is rebiased and the mantissa rounded to nearest even. Values below the smallest normal
+    // half are added to a float whose exponent lines their bits up, so the FPU does the rounding.
+    const unsigned int infinity = 255u << 23, overflow = (127u + 16) << 23, denormal = ((127u - 15) + (23 - 10) + 1) << 23;
+    unsigned int bits, sign;
+    unsigned short half;
+    float magic;
+
+    memcpy(&bits, &value, sizeof(bits));
+    sign = bits & 0x80000000u;
+    bits ^= sign;
+    if (bits >= overflow)
+    {
+        half = bits > infinity ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < (113u << 23))
+    {
+        memcpy(&value, &bits, sizeof(bits));
+        memcpy(&magic, &denormal, sizeof(magic));
+        value += magic;
+        memcpy(&bits, &value, sizeof(bits));
+        half = (unsigned short)(bits - denormal);
+    }
+    else
+    {
+        unsigned int odd = (bits >> 13) & 1;
+        bits += ((unsigned int)(15 - 127) << 23) + 0xfff + odd;
+        half = (unsigned short)(bits >> 13);
+    }
+    return (unsigned short)(half | (sign >> 16));
+}
+
+// Stores sample 'i' of a format wider than a byte: 'd' is the clamped distance, 'v' its 0..1 encoding.
+static void sdf__storeSample(void *out, size_t i, int format, float d, float v)
+{
+    switch (format)
+    {
+    case SDF_FORMAT_UNORM16:
+        ((unsigned short *)out)[i] = (unsigned short)(sdf__clamp01(v + 0.5f / 65535) * 65535.0f);
+        break;
+    case SDF_FORMAT_HALF:
+        ((unsigned short *)out)[i] = sdfFloatToHalf(d);
+        break;
+    default:
+        ((float *)out)[i] = d;
+        break;
+    }
+}
+
+// Copies the squared distances of the rows [y0,y1) to 'out' as floats, SDF_BIG outside the 'band' tiles.
+static void sdf__storeSquared(float *out, const SDFdist *tdist, int width, int nc, int y0, int y1, const unsigned char *band)
+{
+    int y, i, pos, a, b, n = width * nc, tilesx = sdf__bandTiles(width);
+    for (y = y0; y < y1; y++)
+    {
+        const unsigned char *brow = band != NULL ? band + (size_t)(y / SDF_BAND_TILE) * tilesx : NULL;
+        float *row = out + (size_t)y * n;
+        for (pos = 0, i = 0;; i = b * nc)
+        {
+            int more = sdf__bandSpan(brow, 1, width, &pos, &a, &b);
+            for (; i < (more ? a : width) * nc; i++)
+                row[i] = SDF_BIG;
+            if (!more)
+                break;
+            for (i = a * nc; i < b * nc; i++)
+                row[i] = sdf__distToFloat(tdist[(size_t)y * n + i]);
+        }
+    }
+}
+
+// Rows [y0,y1) of sdfContextRemapSquared(), sdf__remap() of float distances without a band.
+static void sdf__remapSquared(unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                              const float *dist, const unsigned char *img, int width, int stride, int pixstride,
+                              const int *coff, int nc, int y0, int y1, unsigned char *linetemp)
+{
+    SDFremapRowFunc remapRow = sdf__remapRowFunc();
+    int x, y, ch, packed = 1, n = width * nc;
+    for (ch = 0; ch < nc; ch++)
+        packed &= coff[ch] == ch;
+    for (y = y0; y < y1; y++)
+    {
+        const unsigned char *in = img + (size_t)y * stride;
+        unsigned char *dst = out + (size_t)y * outstride;
+        if (!packed || pixstride != nc)
+        {
+            for (x = 0; x < width; x++)
+                for (ch = 0; ch < nc; ch++)
+                    linetemp[x * nc + ch] = img[x * pixstride + (size_t)y * stride + coff[ch]];
+            in = linetemp;
+        }
+        if (!packed || outpixstride != nc)
+            dst = linetemp + n;
+        remapRow(dst, dist + (size_t)y * n, in, n, 1.0f / outside_radius, 1.0f / inside_radius);
+        if (dst != out + (size_t)y * outstride)
+        {
+            for (x = 0; x < width; x++)
+                for (ch = 0; ch < nc; ch++)
+                    out[x * outpixstride + (size_t)y * outstride + coff[ch]] = dst[x * nc + ch];
+        }
+    }
+}
+
+// Same as sdf__remap for the formats wider than a byte. The distances are only read, the compact ones
+// are converted on the fly. Pixels outside the 'band' tiles are beyond both radii, so they take the
+// clamped value directly.
+static void sdf__remapWide(void *out, int outstride, int outpixstride, int format, float outside_radius, float inside_radius,
+                           const SDFdist *tdist, const unsigned char *img, int width, int stride, int pixstride,
+                           const int *coff, int nc, int y0, int y1, const unsigned char *band)
+{
+    int x, y, ch, n = width * nc;
+    int tilesx = sdf__bandTiles(width), pos, a, b;
+    const unsigned char *brow;
+
+    for (y = y0; y < y1; y++)
+    {
+        const unsigned char *in = img + y * stride;
+        const SDFdist *dist = tdist + (size_t)y * n;
+        size_t row = (size_t)y * outstride;
+        brow = band != NULL ? band + (size_t)(y / SDF_BAND_TILE) * tilesx : NULL;
+        for (pos = 0, x = 0;; x = b)
+        {
+            int more = sdf__bandSpan(brow, 1, width, &pos, &a, &b);
+            for (; x < (more ? a : width); x++)
+            {
+                for (ch = 0; ch < nc; ch++)
+                {
+                    size_t i = row + x * outpixstride + coff[ch];
+                    if (in[x * pixstride + coff[ch]] > 127)
+                        sdf__storeSample(out, i, format, inside_radius, 1.0f);
+                    else
+                        sdf__storeSample(out, i, format, -outside_radius, 0.0f);
+                }
+            }
+            if (!more)
+                break;
+            for (x = a; x < b; x++)
+            {
+                for (ch = 0; ch < nc; ch++)
+                {
+                    size_t i = row + x * outpixstride + coff[ch];
+                    float d = sqrtf(sdf__distToFloat(dist[x * nc + ch]));
+                    if (in[x * pixstride + coff[ch]] > 127)
+                    {
+                        d = d < inside_radius ? d : inside_radius;
+                        sdf__storeSample(out, i, format, d, 0.5f + 0.5f * d / inside_radius);
+                    }
+                    else
+                    {
+                        d = d < outside_radius ? d : outside_radius;
+                        sdf__storeSample(out, i, format, -d, 0.5f - 0.5f * d / outside_radius);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Worker threads shared by the parallel loops of one build, or kept alive by a context between builds.
+// The loop body is passed as a plain function and data pointer, so handing out work does not allocate.
+struct SDFpool
+{
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    void (*run)(void *job, int i0, int i1, int thread);
+    void *job;
+    std::atomic<int> next;
+    int count, grain;
+    int generation; // Incremented for every loop, workers wait for it to change.
+    int busy;       // Workers still running the current loop.
+    int quit;
+};
+
+static void sdf__poolWork(struct SDFpool *pool, int thread)
+{
+    for (;;)
+    {
+        int i0 = pool->next.fetch_add(pool->grain);
+        if (i0 >= pool->count)
+            break;
+        pool->run(pool->job, i0, i0 + pool->grain < pool->count ? i0 + pool->grain : pool->count, thread);
+    }
+}
+
+static void sdf__poolWorker(struct SDFpool *pool, int thread)
+{
+    int seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(pool->lock);
+            pool->wake.wait(guard, [&] { return pool->quit || pool->generation != seen; });
+            if (pool->quit)
+                return;
+            seen = pool->generation;
+        }
+        sdf__poolWork(pool, thread);
+        {
+            std::lock_guard<std::mutex> guard(pool->lock);
+            if (--pool->busy == 0)
+                pool->done.notify_one();
+        }
+    }
+}
+
+// Starts threads - 1 workers, the thread calling sdf__parallelFor() is the remaining one.
+static void sdf__poolStart(struct SDFpool *pool, int threads)
+{
+    int i;
+    pool->next = 0;
+    pool->count = pool->grain = 0;
+    pool->generation = pool->busy = pool->quit = 0;
+    pool->workers.reserve(threads > 1 ? threads - 1 : 0);
+    for (i = 1; i < threads; i++)
+        pool->workers.emplace_back(sdf__poolWorker, pool, i);
+}
+
+static void sdf__poolStop(struct SDFpool *pool)
+{
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->quit = 1;
+    }
+    pool->wake.notify_all();
+    for (size_t i = 0; i < pool->workers.size(); i++)
+        pool->workers[i].join();
+    pool->workers.clear();
+}
+
+static int sdf__poolThreads(const struct SDFpool *pool)
+{
+    return (int)pool->workers.size() + 1;
+}
+
+// Runs fn(i0, i1, thread) over the range [0,count) in chunks of 'grain' items on the pool threads,
+// the calling thread included. The chunks are handed out dynamically, 'thread' is in [0,sdf__poolThreads()).
+template <typename F>
+static void sdf__parallelFor(struct SDFpool *pool, int count, int grain, F fn)
+{
+    int chunks = (count + grain - 1) / grain;
+
+    if (pool->workers.empty() || chunks <= 1)
+    {
+        if (count > 0)
+            fn(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->run = [](void *job, int i0, int i1, int thread) { (*(F *)job)(i0, i1, thread); };
+        pool->job = &fn;
+        pool->next = 0;
+        pool->count = count;
+        pool->grain = grain;
+        pool->busy = (int)pool->workers.size();
+        pool->generation++;
+    }
+    pool->wake.notify_all();
+    sdf__poolWork(pool, 0);
+    {
+        std::unique_lock<std::mutex> guard(pool->lock);
+        pool->done.wait(guard, [&] { return pool->busy == 0; });
+    }
+}
+
+// Bytes of the per pixel part of the temp memory, rounded so that the line scratch after it stays aligned.
+// Only SDF_ENGINE_EXACT keeps the selected line position of each pixel.
+static size_t sdf__pixelTempSize(size_t npix, int engine)
+{
+    size_t state = sizeof(SDFdist) + sizeof(struct SDFseed) + (engine == SDF_ENGINE_EXACT ? sizeof(int) : 0);
+    return (npix * state + 63) & ~(size_t)63;
+}
+
+static size_t sdf__tempSize(int width, int height, int nc, int threads, int engine)
+{
+    // Distance and nearest point per pixel and channel, plus one block of envelopes per thread.
+    if (threads < 1)
+        threads = 1;
+    return sdf__pixelTempSize((size_t)width * height * nc, engine) + sdf__lineTempSize(width > height ? width : height) * threads;
+}
+
+size_t sdfEngineTempSize(int width, int height, int threads, int engine)
+{
+    return sdf__tempSize(width, height, 1, threads, engine);
+}
+
+size_t sdfTempSize(int width, int height, int threads)
+{
+    return sdf__tempSize(width, height, 1, threads, SDF_ENGINE_EXACT);
+}
+
+static int sdf__channelCount(int channels)
+{
+    return (channels & 1) + ((channels >> 1) & 1) + ((channels >> 2) & 1) + ((channels >> 3) & 1);
+}
+
+const char *sdfPhaseName(int phase)
+{
+    static const char *const names[SDF_PHASE_COUNT] = {"edges", "band", "sweep_forward", "sweep_backward", "exact", "remap", "coverage"};
+    return phase >= 0 && phase < SDF_PHASE_COUNT ? names[phase] : "unknown";
+}
+
+static unsigned long long sdf__now(void)
+{
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Adds the phase that ran from 'start' to now to 'stats', if any, and returns now as the start of the next one.
+static unsigned long long sdf__phaseDone(struct SDFstats *stats, int phase, unsigned long long start, size_t pixels,
+                                         size_t bytes)
+{
+    struct SDFphaseStats *p;
+    unsigned long long now;
+    if (stats == NULL)
+        return 0;
+    now = sdf__now();
+    p = &stats->phases[phase];
+    if (p->start == 0)
+        p->start = start;
+    p->ns += now - start;
+    p->pixels += pixels;
+    p->bytes += bytes;
+    return now;
+}
+
+// Pixels of the image inside the band tiles.
+static size_t sdf__bandPixels(const unsigned char *band, int width, int height)
+{
+    int tilesx = sdf__bandTiles(width), tilesy = sdf__bandTiles(height), tx, ty;
+    size_t pixels = 0;
+    for (ty = 0; ty < tilesy; ty++)
+    {
+        int th = (ty + 1) * SDF_BAND_TILE < height ? SDF_BAND_TILE : height - ty * SDF_BAND_TILE;
+        for (tx = 0; tx < tilesx; tx++)
+        {
+            if (band[(size_t)ty * tilesx + tx])
+                pixels += (size_t)th * ((tx + 1) * SDF_BAND_TILE < width ? SDF_BAND_TILE : width - tx * SDF_BAND_TILE);
+        }
+    }
+    return pixels;
+}
+
+// A pass of SDF_ENGINE_8SSEDT_ADAPTIVE after the first, over row 'y': the neighbours up to two pixels
+// away on the row and on the two rows above when 'dir' is 1, below when it is -1. The single pass only
+// looks one pixel away, which loses the closer point behind a concave corner; the wider stencil finds
+// most of them again. Returns whether a distance of the row went down, 'before' holds a copy of the row.
+static int sdf__sweepWideRow(struct SDFseed *tpt, SDFdist *tdist, int y, int width, int height, int nc,
+                             const unsigned char *band, int dir, SDFdist *before)
+{
+    const unsigned char *brow = band != NULL ? band + (size_t)(y / SDF_BAND_TILE) * sdf__bandTiles(width) : NULL;
+    SDFdist *dist = tdist + (size_t)y * width * nc;
+    int x, pos, a, b, ox, oy;
+
+    memcpy(before, dist, (size_t)width * nc * sizeof(SDFdist));
+    for (pos = 0; sdf__bandSpan(brow, 1, width, &pos, &a, &b);)
+    {
+        for (x = a; x < b; x++)
+        {
+            for (oy = -2 * dir; oy != 0; oy += dir)
+            {
+                for (ox = -2; ox <= 2; ox++)
+                {
+                    if (y + oy >= 0 && y + oy < height && x + ox >= 0 && x + ox < width)
+                        UpdatePoint(tpt, tdist, x, y, ox, oy, width, nc);
+                }
+            }
+            for (ox = -2; ox < 0; ox++)
+            {
+                if (x + ox >= 0)
+                    UpdatePoint(tpt, tdist, x, y, ox, 0, width, nc);
+            }
+        }
+        for (x = b - 1; x >= a; x--)
+        {
+            for (ox = 1; ox <= 2; ox++)
+            {
+                if (x + ox < width)
+                    UpdatePoint(tpt, tdist, x, y, ox, 0, width, nc);
+            }
+        }
+    }
+    return memcmp(before, dist, (size_t)width * nc * sizeof(SDFdist)) != 0;
+}
+
+// SDF_ENGINE_8SSEDT_ADAPTIVE: the 8SSEDT sweeps, then wide passes until one changes no pixel, at most
+// SDF_MAX_PASSES passes in all. A row is swept again only if one of the five rows around it changed
+// since its last sweep, so once the first wide pass is done the cost follows the rows that still
+// change. 'linetemp' holds, per row, the sweep it last changed in and the sweep it was last done in,
+// then a copy of the row being swept. Returns the number of passes, their time goes to 'stats'.
+static int sdf__sweepAdaptive(struct SDFseed *tpt, SDFdist *tdist, int width, int height, int nc, const unsigned char *band,
+                              unsigned char *linetemp, size_t transformed, struct SDFstats *stats, unsigned long long *tick)
+{
+    unsigned char *changed = linetemp, *swept = linetemp + height;
+    SDFdist *before = (SDFdist *)(linetemp + ((2 * (size_t)height + 63) & ~(size_t)63));
+    size_t state = sizeof(SDFdist) + sizeof(struct SDFseed), rows;
+    int passes = 1, sweep = 2, dir, y, i, r, any = 0;
+
+    sdf__sweepForward(tpt, tdist, width, height, nc, band);
+    *tick = sdf__phaseDone(stats, SDF_PHASE_SWEEP_FORWARD, *tick, transformed, transformed * nc * state);
+    sdf__sweepBackward(tpt, tdist, width, height, nc, band);
+    *tick = sdf__phaseDone(stats, SDF_PHASE_SWEEP_BACKWARD, *tick, transformed, transformed * nc * state);
+    if (height < 3)
+        return passes;
+
+    // The first pass counts as sweeps 1 and 2, and as changing the rows it gave a point.
+    memset(swept, 2, height);
+    for (y = 0; y < height; y++)
+    {
+        const struct SDFseed *row = tpt + (size_t)y * width * nc;
+        changed[y] = 0;
+        for (i = 0; i < width * nc && changed[y] == 0; i++)
+            changed[y] = (unsigned char)(sdf__seedValid(&row[i]) ? 2 : 0);
+        any |= changed[y];
+    }
+    while (passes < SDF_MAX_PASSES && any)
+    {
+        passes++;
+        any = 0;
+        for (dir = 1; dir >= -1; dir -= 2)
+        {
+            sweep++;
+            rows = 0;
+            for (i = 1; i < height - 1; i++)
+            {
+                int last = 0;
+                y = dir > 0 ? i : height - 1 - i;
+                for (r = y - 2; r <= y + 2; r++)
+                {
+                    if (r >= 0 && r < height && changed[r] > last)
+                        last = changed[r];
+                }
+                if (last < swept[y])
+                    continue;
+                swept[y] = (unsigned char)sweep;
+                rows++;
+                if (sdf__sweepWideRow(tpt, tdist, y, width, height, nc, band, dir, before))
+                {
+                    changed[y] = (unsigned char)sweep;
+                    any = 1;
+                }
+            }
+            *tick = sdf__phaseDone(stats, dir > 0 ? SDF_PHASE_SWEEP_FORWARD : SDF_PHASE_SWEEP_BACKWARD, *tick,
+                                   transformed * rows / (height - 2), transformed * rows / (height - 2) * nc * state);
+        }
+    }
+    return passes;
+}
+
+// The distances go to 'out' as samples of 'format', the output strides count samples. 'rows', if not
+// NULL, gets the rows as they are done. 'stats', if not NULL, gets the time of every phase added.
+static void sdf__build(struct SDFpool *pool, void *out, int format, int outstride, int outpixstride,
+                       float outside_radius, float inside_radius, const unsigned char *img, int width, int height,
+                       int stride, int pixstride, int channels, int engine, int narrowband, int ox, int oy,
+                       SDFrowsFunc rows, void *user, struct SDFstats *stats, unsigned char *temp)
+{
+    size_t npix = (size_t)width * height * sdf__channelCount(channels);
+    SDFdist *tdist = (SDFdist *)&temp[0];
+    struct SDFseed *tpt = (struct SDFseed *)&temp[npix * sizeof(SDFdist)];
+    int *tsel = (int *)&temp[npix * (sizeof(SDFdist) + sizeof(struct SDFseed))]; // SDF_ENGINE_EXACT only.
+    unsigned char *linetemp = &temp[sdf__pixelTempSize(npix, engine)];
+    size_t linesize = sdf__lineTempSize(width > height ? width : height);
+    unsigned char *band = NULL;
+    int coff[4], nc = 0, i;
+    size_t state = sizeof(SDFdist) + sizeof(struct SDFseed), area = (size_t)width * height, transformed = area;
+    unsigned long long tick = stats != NULL ? sdf__now() : 0;
+
+    // Byte offsets of the selected channels, the transform state keeps them interleaved in this order.
+    for (i = 0; i < 4; i++)
+        if (channels & (1 << i))
+            coff[nc++] = i;
+
+    sdf__parallelFor(pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+        sdf__findEdges(tpt, tdist, img, width, height, stride, pixstride, coff, nc, ox, oy, y0, y1, linetemp + linesize * t);
+    });
+    tick = sdf__phaseDone(stats, SDF_PHASE_EDGES, tick, area, npix * state);
+
+    if (narrowband)
+    {
+        // Everything further than the larger radius from the contour saturates. The contour points are
+        // within a pixel of their own pixel, which the extra margin covers.
+        float reach = (outside_radius > inside_radius ? outside_radius : inside_radius) + 2.0f;
+        band = linetemp + linesize * sdf__poolThreads(pool);
+        sdf__parallelFor(pool, sdf__bandTiles(height), 1, [&](int ty0, int ty1, int) {
+            sdf__bandMark(tpt, width, height, nc, band, ty0, ty1);
+        });
+        sdf__bandDilate(band, band + (size_t)sdf__bandTiles(width) * sdf__bandTiles(height), width, height,
+                        (int)ceilf(reach / SDF_BAND_TILE));
+        if (stats != NULL)
+            transformed = sdf__bandPixels(band, width, height);
+        tick = sdf__phaseDone(stats, SDF_PHASE_BAND, tick, area, npix * sizeof(struct SDFseed));
+    }
+
+    if (engine == SDF_ENGINE_EXACT)
+    {
+        // Separable EDT. The contour points are not on pixel centres, so a single order can pick a
+        // slightly wrong point on steep (columns first) or flat (rows first) edges; run both, keep the nearest.
+        sdf__parallelFor(pool, width, SDF_LINE_BLOCK, [&](int x0, int x1, int t) {
+            sdf__exactPass(tpt, tdist, tsel, width, height, nc, ox, oy, 1, 0, x0, x1, band, linetemp + linesize * t);
+        });
+        sdf__parallelFor(pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+            sdf__exactPass(tpt, tdist, tsel, width, height, nc, ox, oy, 0, 1, y0, y1, band, linetemp + linesize * t);
+        });
+        sdf__parallelFor(pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+            sdf__exactPass(tpt, tdist, tsel, width, height, nc, ox, oy, 0, 0, y0, y1, band, linetemp + linesize * t);
+        });
+        sdf__parallelFor(pool, width, SDF_LINE_BLOCK, [&](int x0, int x1, int t) {
+            sdf__exactPass(tpt, tdist, tsel, width, height, nc, ox, oy, 1, 1, x0, x1, band, linetemp + linesize * t);
+        });
+        tick = sdf__phaseDone(stats, SDF_PHASE_EXACT, tick, transformed, 4 * transformed * nc * (state + sizeof(int)));
+    }
+    else if (engine == SDF_ENGINE_8SSEDT_ADAPTIVE)
+    {
+        // The 8SSEDT pass below, then the wider passes over the rows that still change.
+        int passes = sdf__sweepAdaptive(tpt, tdist, width, height, nc, band, linetemp, transformed, stats, &tick);
+        if (stats != NULL)
+            stats->passes += passes;
+    }
+    else
+    {
+        // 8SSEDT, every row depends on the previous one, the sweeps stay on one thread.
+        sdf__sweepForward(tpt, tdist, width, height, nc, band);
+        tick = sdf__phaseDone(stats, SDF_PHASE_SWEEP_FORWARD, tick, transformed, transformed * nc * state);
+        sdf__sweepBackward(tpt, tdist, width, height, nc, band);
+        tick = sdf__phaseDone(stats, SDF_PHASE_SWEEP_BACKWARD, tick, transformed, transformed * nc * state);
+        if (stats != NULL)
+            stats->passes++;
+    }
+
+    if (format == SDF__FORMAT_SQUARED)
+    {
+        sdf__parallelFor(pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+            sdf__storeSquared((float *)out, tdist, width, nc, y0, y1, band);
+            if (rows != NULL)
+                rows(user, y0, y1, t);
+        });
+    }
+    else if (format != SDF_FORMAT_UNORM8)
+    {
+        sdf__parallelFor(pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+            sdf__remapWide(out, outstride, outpixstride, format, outside_radius, inside_radius, tdist, img, width, stride,
+                           pixstride, coff, nc, y0, y1, band);
+            if (rows != NULL)
+                rows(user, y0, y1, t);
+        });
+    }
+    else
+    {
+        sdf__parallelFor(pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+            sdf__remap((unsigned char *)out, outstride, outpixstride, outside_radius, inside_radius, tdist, img, width, stride,
+                       pixstride, coff, nc, y0, y1, band, linetemp + linesize * t);
+            if (rows != NULL)
+                rows(user, y0, y1, t);
+        });
+    }
+    sdf__phaseDone(stats, SDF_PHASE_REMAP, tick, area, transformed * nc * sizeof(SDFdist));
+    if (stats != NULL)
+        stats->builds++;
+}
+
+void sdfBuildDistanceFieldExNoAlloc(unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                                   const unsigned char *img, int width, int height, int stride, int pixstride,
+                                   int engine, int threads, unsigned char *temp)
+{
+    struct SDFpool pool;
+    sdf__poolStart(&pool, threads);
+    sdf__build(&pool, out, SDF_FORMAT_UNORM8, outstride, outpixstride, outside_radius, inside_radius, img, width, height,
+               stride, pixstride, 1, engine, 0, 0, 0, NULL, NULL, NULL, temp);
+    sdf__poolStop(&pool);
+}
+
+void sdfBuildDistanceFieldNoAlloc(unsigned char *out, int outstride, float outside_radius, float inside_radius,
+                                  const unsigned char *img, int width, int height, int stride,
+                                  unsigned char *temp)
+{
+    sdfBuildDistanceFieldExNoAlloc(out, outstride, 1, outside_radius, inside_radius, img, width, height, stride, 1,
+                                   SDF_ENGINE_8SSEDT, 1, temp);
+}
+
+void sdfBuildDistanceFieldExactNoAlloc(unsigned char *out, int outstride, float outside_radius, float inside_radius,
+                                       const unsigned char *img, int width, int height, int stride,
+                                       unsigned char *temp)
+{
+    sdfBuildDistanceFieldExNoAlloc(out, outstride, 1, outside_radius, inside_radius, img, width, height, stride, 1,
+                                   SDF_ENGINE_EXACT, 1, temp);
+}
+
+int sdfBuildDistanceField(unsigned char *out, int outstride, float outside_radius, float inside_radius,
+                          const unsigned char *img, int width, int height, int stride)
+{
+    unsigned char *temp = (unsigned char *)malloc(sdfEngineTempSize(width, height, 1, SDF_ENGINE_8SSEDT));
+    if (temp == NULL)
+        return 0;
+    sdfBuildDistanceFieldNoAlloc(out, outstride, outside_radius, inside_radius, img, width, height, stride, temp);
+    free(temp);
+    return 1;
+}
+
+int sdfBuildDistanceFieldEx(unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                            const unsigned char *img, int width, int height, int stride, int pixstride,
+                            int engine, int threads)
+{
+    unsigned char *temp;
+    if (engine < SDF_ENGINE_8SSEDT || engine > SDF_ENGINE_8SSEDT_ADAPTIVE)
+        return 0;
+    if (threads < 1)
+        threads = 1;
+    temp = (unsigned char *)malloc(sdfEngineTempSize(width, height, threads, engine));
+    if (temp == NULL)
+        return 0;
+    sdfBuildDistanceFieldExNoAlloc(out, outstride, outpixstride, outside_radius, inside_radius, img, width, height, stride,
+                                   pixstride, engine, threads, temp);
     free(temp);
     return 1;
 }
 
+struct SDFcontext
+{
+    struct SDFpool pool;
+    int flags;
+    unsigned char *scratch;
+    size_t scratchSize; // Bytes usable in 'scratch'.
+    size_t mappedSize;  // Bytes to release, rounded up to the page size.
+    size_t peakScratch;
+    int allocations;
+    SDFrowsFunc rows;
+    void *rowsUser;
+    SDFstats *stats;
+};
+
+// Allocates the context temp memory. Huge pages are tried first when requested, and silently
+// replaced by normal pages if the OS has none to give (no privilege on Windows, no reserved pool on Linux).
+static unsigned char *sdf__allocScratch(size_t size, int flags, size_t *mapped)
+{
+    *mapped = 0;
+    if (flags & SDF_CONTEXT_HUGE_PAGES)
+    {
+#if defined(_WIN32)
+        size_t large = GetLargePageMinimum();
+        void *p = NULL;
+        if (large > 0)
+        {
+            size_t rounded = (size + large - 1) / large * large;
+            p = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (p != NULL)
+                *mapped = rounded;
+        }
+        if (p == NULL)
+        {
+            p = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (p != NULL)
+                *mapped = size;
+        }
+        return (unsigned char *)p;
+#elif defined(__linux__)
+        size_t rounded = (size + (2 << 20) - 1) & ~(size_t)((2 << 20) - 1);
+        void *p = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            // No hugetlbfs pages reserved, ask for transparent huge pages instead.
+            p = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                return NULL;
+#ifdef MADV_HUGEPAGE
+            madvise(p, rounded, MADV_HUGEPAGE);
+#endif
+        }
+        *mapped = rounded;
+        return (unsigned char *)p;
+#endif
+    }
+    return (unsigned char *)malloc(size);
+}
+
+static void sdf__freeScratch(unsigned char *p, size_t mapped)
+{
+    if (p == NULL)
+        return;
+#if defined(_WIN32)
+    if (mapped > 0)
+    {
+        VirtualFree(p, 0, MEM_RELEASE);
+        return;
+    }
+#elif defined(__linux__)
+    if (mapped > 0)
+    {
+        munmap(p, mapped);
+        return;
+    }
+#endif
+    (void)mapped;
+    free(p);
+}
+
+SDFcontext *sdfCreateContext(int threads, int flags)
+{
+    SDFcontext *ctx = new (std::nothrow) SDFcontext;
+    if (ctx == NULL)
+        return NULL;
+    ctx->flags = flags;
+    ctx->scratch = NULL;
+    ctx->scratchSize = 0;
+    ctx->mappedSize = 0;
+    ctx->peakScratch = 0;
+    ctx->allocations = 0;
+    ctx->rows = NULL;
+    ctx->rowsUser = NULL;
+    ctx->stats = NULL;
+    sdf__poolStart(&ctx->pool, threads < 1 ? 1 : threads);
+    return ctx;
+}
+
+void sdfDeleteContext(SDFcontext *ctx)
+{
+    if (ctx == NULL)
+        return;
+    sdf__poolStop(&ctx->pool);
+    sdf__freeScratch(ctx->scratch, ctx->mappedSize);
+    delete ctx;
+}
+
+// Temp memory of a context build of 'nc' channels.
+static size_t sdf__contextTempSize(const SDFcontext *ctx, int width, int height, int nc, int engine)
+{
+    size_t size = sdf__tempSize(width, height, nc, sdf__poolThreads(&ctx->pool), engine);
+    if (ctx->flags & SDF_CONTEXT_NARROW_BAND)
+        size += sdf__bandTempSize(width, height);
+    return size;
+}
+
+// Makes sure the context holds at least 'size' bytes of temp memory. Returns 0 if it could not be allocated.
+static int sdf__contextReserve(SDFcontext *ctx, size_t size)
+{
+    if (size > ctx->scratchSize)
+    {
+        // The old contents are not needed, release first to keep the peak footprint down.
+        sdf__freeScratch(ctx->scratch, ctx->mappedSize);
+        ctx->scratch = sdf__allocScratch(size, ctx->flags, &ctx->mappedSize);
+        ctx->scratchSize = ctx->scratch != NULL ? (ctx->mappedSize > size ? ctx->mappedSize : size) : 0;
+        if (ctx->scratch == NULL)
+            return 0;
+        ctx->allocations++;
+    }
+    if (size > ctx->peakScratch)
+        ctx->peakScratch = size;
+    return 1;
+}
+
+int sdfContextBuildFormat(SDFcontext *ctx, void *out, int outstride, int outpixstride, int format,
+                          float outside_radius, float inside_radius, const unsigned char *img, int width, int height,
+                          int stride, int pixstride, int channels, int engine)
+{
+    if (engine < SDF_ENGINE_8SSEDT || engine > SDF_ENGINE_8SSEDT_ADAPTIVE)
+        return 0;
+    if (format < SDF_FORMAT_UNORM8 || format > SDF_FORMAT_FLOAT)
+        return 0;
+    channels &= 15;
+    if (channels == 0)
+        return 1;
+    if (!sdf__contextReserve(ctx, sdf__contextTempSize(ctx, width, height, sdf__channelCount(channels), engine)))
+        return 0;
+    sdf__build(&ctx->pool, out, format, outstride, outpixstride, outside_radius, inside_radius, img, width, height, stride,
+               pixstride, channels, engine, (ctx->flags & SDF_CONTEXT_NARROW_BAND) != 0, 0, 0, ctx->rows, ctx->rowsUser,
+               ctx->stats, ctx->scratch);
+    return 1;
+}
+
+int sdfContextBuildSquared(SDFcontext *ctx, float *dist, float radius, const unsigned char *img, int width, int height,
+                           int stride, int pixstride, int channels, int engine)
+{
+    int nc = sdf__channelCount(channels & 15);
+    if (engine < SDF_ENGINE_8SSEDT || engine > SDF_ENGINE_8SSEDT_ADAPTIVE)
+        return 0;
+    if (nc == 0)
+        return 1;
+    if (!sdf__contextReserve(ctx, sdf__contextTempSize(ctx, width, height, nc, engine)))
+        return 0;
+    sdf__build(&ctx->pool, dist, SDF__FORMAT_SQUARED, width * nc, nc, radius, radius, img, width, height, stride, pixstride,
+               channels & 15, engine, (ctx->flags & SDF_CONTEXT_NARROW_BAND) != 0, 0, 0, ctx->rows, ctx->rowsUser,
+               ctx->stats, ctx->scratch);
+    return 1;
+}
+
+int sdfContextRemapSquared(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride,
+                           float outside_radius, float inside_radius, const float *dist, const unsigned char *img,
+                           int width, int height, int stride, int pixstride, int channels)
+{
+    unsigned long long tick = ctx->stats != NULL ? sdf__now() : 0;
+    size_t area = (size_t)width * height, linesize;
+    int coff[4], nc = 0, i;
+
+    for (i = 0; i < 4; i++)
+        if (channels & (1 << i))
+            coff[nc++] = i;
+    if (nc == 0)
+        return 1;
+    linesize = ((size_t)2 * width * nc + 63) & ~(size_t)63;
+    if (!sdf__contextReserve(ctx, linesize * sdf__poolThreads(&ctx->pool)))
+        return 0;
+    sdf__parallelFor(&ctx->pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+        sdf__remapSquared(out, outstride, outpixstride, outside_radius, inside_radius, dist, img, width, stride, pixstride,
+                          coff, nc, y0, y1, ctx->scratch + linesize * t);
+        if (ctx->rows != NULL)
+            ctx->rows(ctx->rowsUser, y0, y1, t);
+    });
+    sdf__phaseDone(ctx->stats, SDF_PHASE_REMAP, tick, area, area * nc * (sizeof(float) + 2));
+    return 1;
+}
+
+int sdfContextBuildChannels(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride,
+                            float outside_radius, float inside_radius, const unsigned char *img, int width, int height,
+                            int stride, int pixstride, int channels, int engine)
+{
+    return sdfContextBuildFormat(ctx, out, outstride, outpixstride, SDF_FORMAT_UNORM8, outside_radius, inside_radius, img,
+                                 width, height, stride, pixstride, channels, engine);
+}
+
+int sdfContextBuildFloat(SDFcontext *ctx, float *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                         const unsigned char *img, int width, int height, int stride, int pixstride, int channels, int engine)
+{
+    return sdfContextBuildFormat(ctx, out, outstride, outpixstride, SDF_FORMAT_FLOAT, outside_radius, inside_radius, img,
+                                 width, height, stride, pixstride, channels, engine);
+}
+
+int sdfContextBuild(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride, float outside_radius, float inside_radius,
+                    const unsigned char *img, int width, int height, int stride, int pixstride, int engine)
+{
+    return sdfContextBuildChannels(ctx, out, outstride, outpixstride, outside_radius, inside_radius, img, width, height,
+                                   stride, pixstride, 1, engine);
+}
+
+// Coverage estimate of the rows [y0,y1) of one channel, 'src' holds its bytes, one per pixel, rows
+// 'srcstride' apart. Unless 'outpixstride' is 1 the rows go through 'rowtemp' (width bytes).
+static void sdf__coverageRows(SDFcoverageRowFunc coverageRow, unsigned char *out, int outstride, int outpixstride,
+                              float outside_radius, float inside_radius, const unsigned char *src, int srcstride,
+                              int width, int height, int y0, int y1, unsigned char *rowtemp)
+{
+    int x, y;
+    for (y = y0; y < y1; y++)
+    {
+        unsigned char *dst = outpixstride == 1 ? out + (size_t)y * outstride : rowtemp;
+        if (y == 0 || y == height - 1)
+        {
+            memset(dst, 0, width);
+        }
+        else
+        {
+            const unsigned char *row = src + (size_t)y * srcstride;
+            dst[0] = dst[width - 1] = 0;
+            coverageRow(dst, row - srcstride, row, row + srcstride, 1, width - 1, 1.0f / outside_radius,
+                        1.0f / inside_radius);
+        }
+        if (dst != out + (size_t)y * outstride)
+        {
+            for (x = 0; x < width; x++)
+                out[(size_t)y * outstride + x * outpixstride] = dst[x];
+        }
+    }
+}
+
+void sdfCoverageToDistanceField(unsigned char *out, int outstride,
+                                const unsigned char *img, int width, int height, int stride)
+{
+    sdf__coverageRows(sdf__coverageRowFunc(), out, outstride, 1, SDF_SQRT2 * 0.5f, SDF_SQRT2 * 0.5f, img, stride, width,
+                      height, 0, height, NULL);
+}
+
+int sdfContextCoverageToDistanceField(SDFcontext *ctx, unsigned char *out, int outstride, int outpixstride,
+                                      float outside_radius, float inside_radius, const unsigned char *img, int width,
+                                      int height, int stride, int pixstride, int channels)
+{
+    SDFcoverageRowFunc coverageRow = sdf__coverageRowFunc();
+    unsigned long long tick = ctx->stats != NULL ? sdf__now() : 0;
+    size_t area = (size_t)width * height, planes, rowsize = ((size_t)width + 63) & ~(size_t)63;
+    int coff[4], nc = 0, i, copy;
+
+    for (i = 0; i < 4; i++)
+        if (channels & (1 << i))
+            coff[nc++] = i;
+    if (nc == 0)
+        return 1;
+    // Every row reads its neighbours, which the other threads may be writing in place.
+    copy = pixstride != 1 || out == img;
+    planes = copy ? (area * nc + 63) & ~(size_t)63 : 0;
+    if (!sdf__contextReserve(ctx, planes + rowsize * sdf__poolThreads(&ctx->pool)))
+        return 0;
+
+    if (copy)
+    {
+        sdf__parallelFor(&ctx->pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int) {
+            int y, ch;
+            for (ch = 0; ch < nc; ch++)
+                for (y = y0; y < y1; y++)
+                    sdf__gatherRow(ctx->scratch + area * ch + (size_t)y * width, img + (size_t)y * stride + coff[ch],
+                                   width, pixstride);
+        });
+    }
+    sdf__parallelFor(&ctx->pool, height, SDF_PARALLEL_ROWS, [&](int y0, int y1, int t) {
+        int ch;
+        for (ch = 0; ch < nc; ch++)
+        {
+            const unsigned char *src = copy ? ctx->scratch + area * ch : img + coff[ch];
+            sdf__coverageRows(coverageRow, out + coff[ch], outstride, outpixstride, outside_radius, inside_radius, src,
+                              copy ? width : stride, width, height, y0, y1, ctx->scratch + planes + rowsize * t);
+        }
+        if (ctx->rows != NULL)
+            ctx->rows(ctx->rowsUser, y0, y1, t);
+    });
+    sdf__phaseDone(ctx->stats, SDF_PHASE_COVERAGE, tick, area, area * nc * (copy ? 3 : 2));
+    if (ctx->stats != NULL)
+        ctx->stats->builds++;
+    return 1;
+}
+
+// Pixels read around a tile: the radius, plus the pixel holding a contour point up to a pixel away, plus
+// the neighbours its gradient is taken from.
+static int sdf__tileHalo(float outside_radius, float inside_radius)
+{
+    return (int)ceilf(outside_radius > inside_radius ? outside_radius : inside_radius) + 3;
+}
+
+int sdfContextBuildTiled(SDFcontext *ctx, SDFtileFunc read, SDFtileFunc write, void *user, int width, int height,
+                         int pixstride, int channels, float outside_radius, float inside_radius, int tilesize)
+{
+    int halo = sdf__tileHalo(outside_radius, inside_radius);
+    int winw, winh, x0, y0, x1, y1, wx0, wy0, wx1, wy1;
+    size_t winsize;
+    unsigned char *win;
+
+    channels &= 15;
+    if (channels == 0)
+        return 1;
+    if (tilesize < 1)
+        tilesize = SDF_TILE_SIZE;
+    winw = tilesize + 2 * halo < width ? tilesize + 2 * halo : width;
+    winh = tilesize + 2 * halo < height ? tilesize + 2 * halo : height;
+    winsize = ((size_t)winw * winh * pixstride + 63) & ~(size_t)63;
+    if (!sdf__contextReserve(ctx, winsize + sdf__contextTempSize(ctx, winw, winh, sdf__channelCount(channels), SDF_ENGINE_EXACT)))
+        return 0;
+    win = ctx->scratch;
+
+    for (y0 = 0; y0 < height; y0 += tilesize)
+    {
+        y1 = y0 + tilesize < height ? y0 + tilesize : height;
+        wy0 = y0 - halo > 0 ? y0 - halo : 0;
+        wy1 = y1 + halo < height ? y1 + halo : height;
+        for (x0 = 0; x0 < width; x0 += tilesize)
+        {
+            int ww, wh;
+            x1 = x0 + tilesize < width ? x0 + tilesize : width;
+            wx0 = x0 - halo > 0 ? x0 - halo : 0;
+            wx1 = x1 + halo < width ? x1 + halo : width;
+            ww = wx1 - wx0;
+            wh = wy1 - wy0;
+
+            // Bake the window in place, in the coordinates of the whole image, and hand out its middle.
+            if (!read(user, win, ww * pixstride, wx0, wy0, wx1, wy1))
+                return 0;
+            sdf__build(&ctx->pool, win, SDF_FORMAT_UNORM8, ww * pixstride, pixstride, outside_radius, inside_radius, win, ww,
+                       wh, ww * pixstride, pixstride, channels, SDF_ENGINE_EXACT, (ctx->flags & SDF_CONTEXT_NARROW_BAND) != 0,
+                       wx0, wy0, NULL, NULL, ctx->stats, ctx->scratch + winsize);
+            if (!write(user, win + ((size_t)(y0 - wy0) * ww + (x0 - wx0)) * pixstride, ww * pixstride, x0, y0, x1, y1))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+void sdfContextSetRowsCallback(SDFcontext *ctx, SDFrowsFunc rows, void *user)
+{
+    ctx->rows = rows;
+    ctx->rowsUser = user;
+}
+
+void sdfContextRun(SDFcontext *ctx, int count, SDFtaskFunc task, void *user)
+{
+    sdf__parallelFor(&ctx->pool, count, 1, [&](int i0, int i1, int t) {
+        int i;
+        for (i = i0; i < i1; i++)
+            task(user, i, t);
+    });
+}
+
+void sdfContextSetStats(SDFcontext *ctx, SDFstats *stats)
+{
+    ctx->stats = stats;
+}
+
+int sdfContextThreads(const SDFcontext *ctx)
+{
+    return sdf__poolThreads(&ctx->pool);
+}
+
+int sdfContextFlags(const SDFcontext *ctx)
+{
+    return ctx->flags;
+}
+
+size_t sdfContextScratchSize(const SDFcontext *ctx)
+{
+    return ctx->scratchSize;
+}
+
+size_t sdfContextPeakScratch(const SDFcontext *ctx)
+{
+    return ctx->peakScratch;
+}
+
+int sdfContextAllocations(const SDFcontext *ctx)
+{
+    return ctx->allocations;
+}
+
 #endif // SDF_IMPLEMENTATION
@@ -13,9 +13,12 @@
 #include <d3d11.h>
 #include <tchar.h>
 #include <string>
+#include <vector>
 #include <cstring>
 #include <algorithm>
 #include <iostream>
+#include <chrono>
+#include <thread>
 
 #define _CRT_SECURE_NO_WARNINGS
 #define STB_IMAGE_IMPLEMENTATION
@@ -35,12 +38,17 @@ static ID3D11DeviceContext *g_pd3dDeviceContext = nullptr;
 static IDXGISwapChain *g_pSwapChain = nullptr;
 static UINT g_ResizeWidth = 0, g_ResizeHeight = 0;
 static ID3D11RenderTargetView *g_mainRenderTargetView = nullptr;
+static ID3D11Texture2D *g_previewTexture = nullptr;
+static ID3D11ShaderResourceView *g_previewView = nullptr;
+static UINT g_previewWidth = 0, g_previewHeight = 0;
 
 // Forward declarations of helper functions
 bool CreateDeviceD3D(HWND hWnd);
 void CleanupDeviceD3D();
 void CreateRenderTarget();
 void CleanupRenderTarget();
+void UpdatePreview(const unsigned char *data, int width, int height, int pixstride, int channel);
+void CleanupPreview();
 LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 inline bool ends_with(std::string const &value, std::string const &ending)
@@ -97,15 +105,38 @@ int main(int, char **)
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
     // Sdf state
-    int radius = 64;
+    const int maxRadius = 256;
+    int outside_radius = 64;
+    int inside_radius = 64;
     bool use_channel_r = false;
     bool use_channel_g = false;
     bool use_channel_b = false;
     bool use_channel_a = true;
+    int engine = SDF_ENGINE_8SSEDT;
+    int threads = std::thread::hardware_concurrency() > 0 ? (int)std::thread::hardware_concurrency() : 1;
+    bool narrow_band = true;
     std::string sourceFileName;
+    SDFcontext *sdfContext = nullptr; // Keeps the bake scratch memory and threads between bakes.
 
-    unsigned int SizeX, SizeY, Comp, ElementSize, PixelSize;
-    unsigned char *charData = nullptr;
+    unsigned int SizeX, SizeY, Comp, ElementSize;
+    unsigned char *sourceData = nullptr; // The image as loaded, the bakes never write to it.
+    unsigned char *charData = nullptr;   // The baked image, saved by the File menu.
+
+    // Squared distances of the last bake, up to maxRadius. Radius changes only remap them.
+    std::vector<float> field;
+    int fieldChannels = 0;
+    double remapTime = 0.0;
+    auto remapField = [&]()
+    {
+        auto remapStart = std::chrono::steady_clock::now();
+        sdfContextRemapSquared(sdfContext, charData, SizeX * Comp, Comp, (float)outside_radius, (float)inside_radius,
+                               field.data(), sourceData, SizeX, SizeY, SizeX * Comp, Comp, fieldChannels);
+        remapTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - remapStart).count();
+        int channel = 0;
+        while (channel + 1 < (int)Comp && !(fieldChannels & (1 << channel)))
+            channel++;
+        UpdatePreview(charData, SizeX, SizeY, Comp, channel);
+    };
 
     // Main loop
     bool done = false;
@@ -169,31 +200,34 @@ int main(int, char **)
                         ofn.Flags = OFN_EXPLORER | OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
 
                         // Display the Open dialog box.
+                        int sizeX, sizeY, comp;
+                        unsigned char *SrcCharData = nullptr;
                         if (GetOpenFileName(&ofn))
+                            SrcCharData = stbi_load(szFile, &sizeX, &sizeY, &comp, 0);
+                        if (SrcCharData != nullptr)
                         {
                             sourceFileName = std::string(szFile);
                             std::transform(sourceFileName.begin(), sourceFileName.end(), sourceFileName.begin(), ::tolower);
-                        }
 
-                        // free old data
-                        if (charData != nullptr)
-                        {
+                            // free old data
+                            delete[] sourceData;
                             delete[] charData;
-                            charData = nullptr;
+                            field.clear();
+                            fieldChannels = 0;
+
+                            // Data Prepare, the bakes start over from the source every time.
+                            SizeX = sizeX;
+                            SizeY = sizeY;
+                            Comp = comp;
+                            ElementSize = SizeX * SizeY * Comp;
+                            sourceData = new unsigned char[ElementSize];
+                            charData = new unsigned char[ElementSize];
+                            std::memcpy(sourceData, SrcCharData, ElementSize);
+                            std::memcpy(charData, SrcCharData, ElementSize);
+                            stbi_image_free(SrcCharData);
+                            UpdatePreview(charData, SizeX, SizeY, Comp, Comp == 4 ? 3 : 0);
+                            Log("Open File: " + sourceFileName);
                         }
-
-                        // Data Prepare
-                        int sizeX, sizeY, comp;
-                        unsigned char *SrcCharData = stbi_load(szFile, &sizeX, &sizeY, &comp, 4);
-                        SizeX = sizeX;
-                        SizeY = sizeY;
-                        Comp = comp;
-                        ElementSize = SizeX * SizeY * Comp;
-                        PixelSize = SizeX * SizeY;
-                        charData = new unsigned char[ElementSize];
-                        std::memcpy(charData, SrcCharData, ElementSize);
-                        stbi_image_free(SrcCharData);
-                        Log("Open File: " + sourceFileName);
                     }
 
                     if (ImGui::MenuItem("Save"))
@@ -257,73 +291,93 @@ int main(int, char **)
             ImGui::Checkbox("Blue", &use_channel_b);
             ImGui::Checkbox("Alpha", &use_channel_a);
 
-            ImGui::Text("Seach Radius: ");
+            ImGui::Text("Outside Radius: ");
+            ImGui::SameLine();
+            bool radiusChanged = ImGui::SliderInt("##outside", &outside_radius, 1, maxRadius);
+            ImGui::Text("Inside Radius: ");
+            ImGui::SameLine();
+            radiusChanged |= ImGui::SliderInt("##inside", &inside_radius, 1, maxRadius);
+
+            ImGui::Text("Engine: ");
+            ImGui::SameLine();
+            ImGui::Combo("##engine", &engine, "8SSEDT\0Exact EDT\0" "8SSEDT Adaptive\0");
+
+            ImGui::Text("Threads: ");
             ImGui::SameLine();
-            ImGui::SliderInt("pixels", &radius, 1, 256);
+            ImGui::SliderInt("##threads", &threads, 1, 64);
+            ImGui::Checkbox("Narrow Band", &narrow_band);
 
-            if (ImGui::Button("Bake Sdf"))
+            if (ImGui::Button("Bake Sdf") && sourceData != nullptr)
             {
-                if (use_channel_r)
+                auto bakeStart = std::chrono::steady_clock::now();
+                const bool use_channel[4] = {use_channel_r, use_channel_g, use_channel_b, use_channel_a && Comp == 4};
+                const char *channelName[4] = {"Red", "Green", "Blue", "Alpha"};
+                int channels = 0, channelCount = 0;
+                for (unsigned int c = 0; c < 4 && c < Comp; c++)
                 {
-                    unsigned char *channelData = new unsigned char[PixelSize];
-                    for (unsigned int i = 0; i < PixelSize; i++)
+                    if (use_channel[c])
                     {
-                        channelData[i] = charData[i * Comp];
+                        channels |= 1 << c;
+                        channelCount++;
                     }
-                    sdfBuildDistanceField(channelData, SizeX, radius, radius, channelData, SizeX, SizeY, SizeX);
-                    for (unsigned int i = 0; i < PixelSize; i++)
-                    {
-                        charData[i * Comp] = channelData[i];
-                    }
-                    delete channelData;
-                    Log("Bake Red Channel Success.");
                 }
-                if (use_channel_g)
+                int contextFlags = SDF_CONTEXT_HUGE_PAGES | (narrow_band ? SDF_CONTEXT_NARROW_BAND : 0);
+                if (sdfContext != nullptr && (sdfContextThreads(sdfContext) != threads || sdfContextFlags(sdfContext) != contextFlags))
                 {
-                    unsigned char *channelData = new unsigned char[PixelSize];
-                    for (unsigned int i = 0; i < PixelSize; i++)
-                    {
-                        channelData[i] = charData[i * Comp + 1];
-                    }
-                    sdfBuildDistanceField(channelData, SizeX, radius, radius, channelData, SizeX, SizeY, SizeX);
-                    for (unsigned int i = 0; i < PixelSize; i++)
-                    {
-                        charData[i * Comp + 1] = channelData[i];
-                    }
-                    delete channelData;
-                    Log("Bake Green Channel Success.");
+                    sdfDeleteContext(sdfContext);
+                    sdfContext = nullptr;
                 }
-                if (use_channel_b)
+                if (sdfContext == nullptr && channels != 0)
                 {
-                    unsigned char *channelData = new unsigned char[PixelSize];
-                    for (unsigned int i = 0; i < PixelSize; i++)
-                    {
-                        channelData[i] = charData[i * Comp + 2];
-                    }
-                    sdfBuildDistanceField(channelData, SizeX, radius, radius, channelData, SizeX, SizeY, SizeX);
-                    for (unsigned int i = 0; i < PixelSize; i++)
-                    {
-                        charData[i * Comp + 2] = channelData[i];
-                    }
-                    delete channelData;
-                    Log("Bake Blue Channel Success.");
+                    sdfContext = sdfCreateContext(threads, contextFlags);
                 }
-                if (use_channel_a && Comp == 4)
+                // The field of the last bake stays only if nothing replaces it.
+                fieldChannels = 0;
+                if (channels == 0)
                 {
-                    unsigned char *channelData = new unsigned char[PixelSize];
-                    for (unsigned int i = 0; i < PixelSize; i++)
-                    {
-                        channelData[i] = charData[i * Comp + 3];
-                    }
-                    sdfBuildDistanceField(channelData, SizeX, radius, radius, channelData, SizeX, SizeY, SizeX);
-                    for (unsigned int i = 0; i < PixelSize; i++)
+                    Log("Bake Failed: none of the selected channels is in the image.");
+                }
+                else if (sdfContext == nullptr)
+                {
+                    Log("Bake Failed: cannot create the sdf context.");
+                }
+                else
+                {
+                    // Transform all selected channels of the source in one pass over the interleaved pixels,
+                    // then remap the field to the current radii.
+                    field.resize((size_t)SizeX * SizeY * channelCount);
+                    if (sdfContextBuildSquared(sdfContext, field.data(), (float)maxRadius, sourceData, SizeX, SizeY,
+                                               SizeX * Comp, Comp, channels, engine))
                     {
-                        charData[i * Comp + 3] = channelData[i];
+                        fieldChannels = channels;
+                        std::memcpy(charData, sourceData, ElementSize); // Unselected channels go back to the source.
+                        remapField();
+                        for (unsigned int c = 0; c < 4; c++)
+                        {
+                            if (channels & (1 << c))
+                                Log(std::string("Bake ") + channelName[c] + " Channel Success.");
+                        }
                     }
-                    delete channelData;
-                    Log("Bake Alpha Channel Success.");
+                    auto bakeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+                    Log("Bake Time: " + std::to_string(bakeTime) + " ms");
+                    Log("Bake Scratch Peak: " + std::to_string(sdfContextPeakScratch(sdfContext) >> 10) + " KB, " +
+                        std::to_string(sdfContextAllocations(sdfContext)) + " allocations");
                 }
             }
+            else if (radiusChanged && fieldChannels != 0)
+            {
+                // Only the remap of the cached field reruns, fast enough to follow the slider.
+                remapField();
+            }
+            if (fieldChannels != 0)
+                ImGui::Text("Remap Time: %.2f ms", remapTime);
+
+            if (g_previewView != nullptr)
+            {
+                UINT side = g_previewWidth > g_previewHeight ? g_previewWidth : g_previewHeight;
+                float scale = side > 512 ? 512.0f / side : 1.0f;
+                ImGui::Image((ImTextureID)g_previewView, ImVec2(g_previewWidth * scale, g_previewHeight * scale));
+            }
 
             ImGui::End();
         }
@@ -340,7 +394,10 @@ int main(int, char **)
     }
 
     // Sdf resource release
+    delete[] sourceData;
     delete[] charData;
+    CleanupPreview();
+    sdfDeleteContext(sdfContext);
 
     // Cleanup
     ImGui_ImplDX11_Shutdown();
@@ -460,3 +517,53 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
     }
     return ::DefWindowProcW(hWnd, msg, wParam, lParam);
 }
+
+// Shows one channel of an image as grey in the preview texture, recreated when the size changes.
+void UpdatePreview(const unsigned char *data, int width, int height, int pixstride, int channel)
+{
+    static std::vector<unsigned char> rgba;
+    if (g_previewTexture == nullptr || g_previewWidth != (UINT)width || g_previewHeight != (UINT)height)
+    {
+        CleanupPreview();
+        D3D11_TEXTURE2D_DESC desc;
+        ZeroMemory(&desc, sizeof(desc));
+        desc.Width = width;
+        desc.Height = height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        if (g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_previewTexture) != S_OK) // Too large for a texture.
+            return;
+        g_pd3dDevice->CreateShaderResourceView(g_previewTexture, nullptr, &g_previewView);
+        g_previewWidth = width;
+        g_previewHeight = height;
+    }
+    rgba.resize((size_t)width * height * 4);
+    for (size_t i = 0; i < (size_t)width * height; i++)
+    {
+        unsigned char value = data[i * pixstride + channel];
+        rgba[i * 4 + 0] = value;
+        rgba[i * 4 + 1] = value;
+        rgba[i * 4 + 2] = value;
+        rgba[i * 4 + 3] = 255;
+    }
+    g_pd3dDeviceContext->UpdateSubresource(g_previewTexture, 0, nullptr, rgba.data(), width * 4, 0);
+}
+
+void CleanupPreview()
+{
+    if (g_previewView)
+    {
+        g_previewView->Release();
+        g_previewView = nullptr;
+    }
+    if (g_previewTexture)
+    {
+        g_previewTexture->Release();
+        g_previewTexture = nullptr;
+    }
+    g_previewWidth = g_previewHeight = 0;
+}
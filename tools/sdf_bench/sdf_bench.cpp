@@ -0,0 +1,707 @@
+// sdf_bench: micro-benchmarks of the ext/sdf kernels.
+//
+//   sdf_bench [--sizes 64,256,...] [--inputs circles,text,...] [--min-time S] [--max-mb N] [--json FILE]
+//   sdf_bench --quality [...]
+//   sdf_bench --check
+//
+// The implementation is compiled into this file, so the phases of the 8SSEDT build are timed on their
+// own, on one thread and without the narrow band: the gradient pre-pass (buffer init and edge points),
+// the forward and backward sweeps and the remap. Each is reported as ns per pixel and as GB/s of the
+// scratch it reads and writes, an estimate from the sizes of the per pixel state. The full context
+// builds are timed next to them, every engine with and without the band, along with the number of scratch
+// allocations the context made over all the repetitions, which should stay at one. Last comes the
+// coverage estimate that replaces the builds at the smallest radii, with SIMD and in plain C, and the
+// remap of a squared-distance field built once, which is all a radius change costs the app.
+//
+// --quality weighs the engines against what they give up instead: every engine bakes the float distances
+// of the same masks, which are compared to a brute-force reference, the distance from every pixel to the
+// nearest of all the subpixel contour points the gradient pre-pass finds, clamped to the same radius.
+// That is the distance the transforms approximate, so the error is the propagation error alone. The max
+// and RMS error in pixels go next to the ns per pixel of the build. The one pixel border is left out,
+// the 8SSEDT does not compute it. sdfCoverageToDistanceField() runs at the radius its bytes encode,
+// sqrt(2)/2, along with the other engines at that radius.
+//
+// --check times nothing: it compares the coverage rows at every SIMD level to each other, and to the
+// coverage estimate of the library before the row kernels on isolated partial pixels, whose flat
+// neighbourhood has no gradient. It prints the mismatches and fails if there are any, ctest runs it.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define SDF_IMPLEMENTATION
+#include "sdf.h"
+#include "stb_easy_font.h"
+
+#define BENCH_RADIUS 16.0f
+
+struct BenchResult
+{
+    std::string input, phase;
+    int size;
+    double ns_per_pixel, gb_per_s;
+    int allocations;
+    float radius = 0.0f;                       // Of the --quality runs,
+    double max_error = -1.0, rms_error = -1.0; // in pixels.
+};
+
+static unsigned int bench_seed = 12345;
+
+static float Random01()
+{
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    return (bench_seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static void AddCircle(std::vector<unsigned char> &img, int n, float cx, float cy, float r)
+{
+    int x0 = (int)(cx - r - 1), x1 = (int)(cx + r + 2), y0 = (int)(cy - r - 1), y1 = (int)(cy + r + 2);
+    for (int y = y0 > 0 ? y0 : 0; y < y1 && y < n; y++)
+    {
+        for (int x = x0 > 0 ? x0 : 0; x < x1 && x < n; x++)
+        {
+            float dx = x + 0.5f - cx, dy = y + 0.5f - cy;
+            float a = r + 0.5f - sqrtf(dx * dx + dy * dy);
+            a = a < 0.0f ? 0.0f : a > 1.0f ? 1.0f : a;
+            unsigned char &p = img[(size_t)y * n + x];
+            p = p > (unsigned char)(a * 255.0f + 0.5f) ? p : (unsigned char)(a * 255.0f + 0.5f);
+        }
+    }
+}
+
+// Box filtered coverage of an axis aligned rectangle.
+static void AddRect(std::vector<unsigned char> &img, int n, float x0, float y0, float x1, float y1)
+{
+    for (int y = (int)y0 > 0 ? (int)y0 : 0; y < y1 && y < n; y++)
+    {
+        float cy = (y + 1 < y1 ? y + 1 : y1) - (y > y0 ? y : y0);
+        for (int x = (int)x0 > 0 ? (int)x0 : 0; x < x1 && x < n; x++)
+        {
+            float cx = (x + 1 < x1 ? x + 1 : x1) - (x > x0 ? x : x0);
+            unsigned char &p = img[(size_t)y * n + x];
+            int v = p + (int)(cx * cy * 255.0f + 0.5f);
+            p = (unsigned char)(v > 255 ? 255 : v);
+        }
+    }
+}
+
+// Antialiased synthetic masks of n x n pixels; the shapes scale with the size.
+static bool MakeInput(std::string const &name, int n, std::vector<unsigned char> &img)
+{
+    bench_seed = 12345;
+    img.assign((size_t)n * n, 0);
+    if (name == "circles")
+    {
+        for (int i = 0; i < 24; i++)
+            AddCircle(img, n, Random01() * n, Random01() * n, n * (0.025f + 0.075f * Random01()));
+    }
+    else if (name == "text")
+    {
+        static char line[] = "The quick brown fox jumps over the lazy dog 0123456789 SDF {}[]()";
+        static float quads[4 * 4 * 2048];
+        int count = stb_easy_font_print(0, 0, line, NULL, quads, sizeof(quads));
+        float scale = n / 320.0f > 1.0f ? n / 320.0f : 1.0f;
+        for (float y = 2; (y + 12) * scale < n; y += 12)
+        {
+            for (int q = 0; q < count; q++)
+            {
+                const float *v = quads + q * 16; // Four vertices of x, y, z and a color.
+                AddRect(img, n, (v[0] + 2) * scale, (v[1] + y) * scale, (v[8] + 2) * scale, (v[9] + y) * scale);
+            }
+        }
+    }
+    else if (name == "noise")
+    {
+        for (unsigned char &p : img)
+            p = (unsigned char)(Random01() * 256.0f);
+    }
+    else if (name == "dots")
+    {
+        int step = n / 16 > 4 ? n / 16 : 4;
+        for (int y = step / 2; y < n; y += step)
+        {
+            for (int x = step / 2; x < n; x += step)
+                AddCircle(img, n, x + Random01() * 2, y + Random01() * 2, 1.5f);
+        }
+    }
+    else if (name == "solid")
+    {
+        memset(img.data(), 255, img.size());
+    }
+    else if (name != "empty")
+    {
+        return false;
+    }
+    return true;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Report(std::vector<BenchResult> &results, std::string const &input, int n, const char *phase, double seconds,
+                   double bytes_per_pixel, int allocations)
+{
+    double pixels = (double)n * n;
+    BenchResult r = {input, phase, n, seconds * 1e9 / pixels, bytes_per_pixel * pixels / seconds / 1e9, allocations};
+    printf("%-8s %6d  %-19s %9.3f ns/px %8.2f GB/s", input.c_str(), n, phase, r.ns_per_pixel, r.gb_per_s);
+    if (allocations >= 0)
+        printf("  %d allocations", allocations);
+    printf("\n");
+    results.push_back(r);
+}
+
+// The phases of sdf__build() for one channel, fastest of the repetitions.
+static void BenchPhases(std::vector<BenchResult> &results, std::string const &input, int n,
+                        std::vector<unsigned char> const &img, unsigned char *temp, unsigned char *out, double min_time)
+{
+    size_t npix = (size_t)n * n;
+    SDFdist *tdist = (SDFdist *)&temp[0];
+    struct SDFseed *tpt = (struct SDFseed *)&temp[npix * sizeof(SDFdist)];
+    unsigned char *linetemp = &temp[sdf__pixelTempSize(npix, SDF_ENGINE_8SSEDT)];
+    int coff[1] = {0};
+    double best[4] = {1e30, 1e30, 1e30, 1e30}, total = 0;
+    for (int rep = 0; rep == 0 || total < min_time; rep++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        sdf__findEdges(tpt, tdist, img.data(), n, n, n, 1, coff, 1, 0, 0, 0, n, linetemp);
+        double t0 = Seconds(start);
+        sdf__sweepForward(tpt, tdist, n, n, 1, NULL);
+        double t1 = Seconds(start);
+        sdf__sweepBackward(tpt, tdist, n, n, 1, NULL);
+        double t2 = Seconds(start);
+        sdf__remap(out, n, 1, BENCH_RADIUS, BENCH_RADIUS, tdist, img.data(), n, n, 1, coff, 1, 0, n, NULL, linetemp);
+        double t3 = Seconds(start);
+        double times[4] = {t0, t1 - t0, t2 - t1, t3 - t2};
+        for (int i = 0; i < 4; i++)
+            best[i] = times[i] < best[i] ? times[i] : best[i];
+        total += t3;
+    }
+    double state = sizeof(struct SDFseed) + sizeof(SDFdist);
+    Report(results, input, n, "edges", best[0], 1 + state, -1);
+    Report(results, input, n, "sweep_forward", best[1], 2 * state, -1);
+    Report(results, input, n, "sweep_backward", best[2], 2 * state, -1);
+    Report(results, input, n, "remap", best[3], sizeof(SDFdist) + 2, -1);
+}
+
+static void BenchBuild(std::vector<BenchResult> &results, std::string const &input, int n,
+                       std::vector<unsigned char> const &img, unsigned char *out, const char *phase, int engine,
+                       int flags, double min_time)
+{
+    SDFcontext *ctx = sdfCreateContext(1, flags);
+    if (ctx == NULL)
+        return;
+    double best = 1e30, total = 0;
+    for (int rep = 0; rep == 0 || total < min_time; rep++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        int ok = sdfContextBuild(ctx, out, n, 1, BENCH_RADIUS, BENCH_RADIUS, img.data(), n, n, n, 1, engine);
+        double t = Seconds(start);
+        if (!ok)
+        {
+            printf("%-8s %6d  %-19s failed\n", input.c_str(), n, phase);
+            sdfDeleteContext(ctx);
+            return;
+        }
+        best = t < best ? t : best;
+        total += t;
+    }
+    Report(results, input, n, phase, best, 2 + 2 * (sizeof(struct SDFseed) + sizeof(SDFdist)), sdfContextAllocations(ctx));
+    sdfDeleteContext(ctx);
+}
+
+// sdfContextCoverageToDistanceField() at its largest radius, with the best SIMD level and in plain C.
+static void BenchCoverage(std::vector<BenchResult> &results, std::string const &input, int n,
+                          std::vector<unsigned char> const &img, unsigned char *out, double min_time)
+{
+    SDFcontext *ctx = sdfCreateContext(1, 0);
+    if (ctx == NULL)
+        return;
+    int simd = sdfSetSimdLevel(SDF_SIMD_AVX2);
+    for (int level : {simd, (int)SDF_SIMD_NONE})
+    {
+        sdfSetSimdLevel(level);
+        double best = 1e30, total = 0;
+        for (int rep = 0; rep == 0 || total < min_time; rep++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            sdfContextCoverageToDistanceField(ctx, out, n, 1, SDF_COVERAGE_RADIUS, SDF_COVERAGE_RADIUS, img.data(), n, n, n, 1, 1);
+            double t = Seconds(start);
+            best = t < best ? t : best;
+            total += t;
+        }
+        Report(results, input, n, level == simd ? "coverage" : "coverage_scalar", best, 2, sdfContextAllocations(ctx));
+    }
+    sdfSetSimdLevel(simd);
+    sdfDeleteContext(ctx);
+}
+
+// sdfContextRemapSquared() of a field built once, the cost of a radius change in the app.
+static void BenchRemapCached(std::vector<BenchResult> &results, std::string const &input, int n,
+                             std::vector<unsigned char> const &img, unsigned char *out, double min_time)
+{
+    SDFcontext *ctx = sdfCreateContext(1, 0);
+    if (ctx == NULL)
+        return;
+    std::vector<float> field((size_t)n * n);
+    if (!sdfContextBuildSquared(ctx, field.data(), BENCH_RADIUS, img.data(), n, n, n, 1, 1, SDF_ENGINE_8SSEDT))
+    {
+        sdfDeleteContext(ctx);
+        return;
+    }
+    double best = 1e30, total = 0;
+    for (int rep = 0; rep == 0 || total < min_time; rep++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        sdfContextRemapSquared(ctx, out, n, 1, BENCH_RADIUS * 0.5f, BENCH_RADIUS, field.data(), img.data(), n, n, n, 1, 1);
+        double t = Seconds(start);
+        best = t < best ? t : best;
+        total += t;
+    }
+    Report(results, input, n, "remap_cached", best, sizeof(float) + 2, sdfContextAllocations(ctx));
+    sdfDeleteContext(ctx);
+}
+
+// sdfCoverageToDistanceField() as the library had it before the row kernels, the reference of --check.
+static void ReferenceCoverage(unsigned char *out, int outstride, const unsigned char *img, int width, int height, int stride)
+{
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int k = x + y * stride;
+            float d, gx, gy, glen, a, a1;
+            if (x == 0 || y == 0 || x == width - 1 || y == height - 1)
+            {
+                out[x + y * outstride] = 0;
+                continue;
+            }
+            if (img[k] == 255 || (img[k] == 0 && img[k - 1] != 255 && img[k + 1] != 255 && img[k - stride] != 255 &&
+                                  img[k + stride] != 255))
+            {
+                out[x + y * outstride] = img[k];
+                continue;
+            }
+            gx = -(float)img[k - stride - 1] - SDF_SQRT2 * (float)img[k - 1] - (float)img[k + stride - 1] +
+                 (float)img[k - stride + 1] + SDF_SQRT2 * (float)img[k + 1] + (float)img[k + stride + 1];
+            gy = -(float)img[k - stride - 1] - SDF_SQRT2 * (float)img[k - stride] - (float)img[k - stride + 1] +
+                 (float)img[k + stride - 1] + SDF_SQRT2 * (float)img[k + stride] + (float)img[k + stride + 1];
+            a = (float)img[k] / 255.0f;
+            gx = fabsf(gx);
+            gy = fabsf(gy);
+            if (gx < 0.0001f)
+            {
+                d = (0.5f - a) * SDF_SQRT2;
+            }
+            else
+            {
+                glen = 1.0f / sqrtf(gx * gx + gy * gy);
+                gx *= glen;
+                gy *= glen;
+                if (gx < gy)
+                {
+                    float temp = gx;
+                    gx = gy;
+                    gy = temp;
+                }
+                a1 = 0.5f * gy / gx;
+                if (a < a1)
+                    d = 0.5f * (gx + gy) - sqrtf(2.0f * gx * gy * a);
+                else if (a < (1.0 - a1))
+                    d = (0.5f - a) * gx;
+                else
+                    d = -0.5f * (gx + gy) + sqrt(2.0f * gx * gy * (1.0f - a));
+            }
+            d *= 1.0f / SDF_SQRT2;
+            out[x + y * outstride] = (unsigned char)(sdf__clamp01(0.5f - d) * 255.0f);
+        }
+    }
+}
+
+// Pixels of 'a' and 'b' more than 'tolerance' steps apart, of those listed in 'pixels' when not empty.
+// The first one is printed as 'what'.
+static int CountMismatches(std::vector<unsigned char> const &a, std::vector<unsigned char> const &b, int width, int tolerance,
+                           std::vector<size_t> const &pixels, std::string const &what)
+{
+    int count = 0;
+    for (size_t j = 0; j < (pixels.empty() ? a.size() : pixels.size()); j++)
+    {
+        size_t i = pixels.empty() ? j : pixels[j];
+        if (abs(a[i] - b[i]) > tolerance && count++ == 0)
+            printf("%s: pixel (%d, %d) is %d, expected %d\n", what.c_str(), (int)(i % width), (int)(i / width), b[i], a[i]);
+    }
+    return count;
+}
+
+// --check, returns the number of mismatching pixels.
+static int CheckCoverage()
+{
+    // A pixel of every value alone in a 0 neighbourhood, then in a 255 one, spread over the SIMD blocks and
+    // the scalar tails of rows whose width is not a multiple of 32. Their gradient is zero.
+    const int width = 301, height = 2 + 8 * 4, cells = 74;
+    std::vector<unsigned char> img((size_t)width * height, 0), ref(img.size()), out(img.size()), scalar;
+    std::vector<size_t> isolated;
+    for (int v = 0; v < 2 * 256; v++)
+    {
+        int cell = v + (v >= 256 ? 4 * cells - 256 : 0);
+        int x = 2 + (cell % cells) * 4, y = 2 + (cell / cells) * 4;
+        if (v >= 256)
+        {
+            for (int dy = -1; dy <= 1; dy++)
+                memset(&img[(size_t)(y + dy) * width + x - 1], 255, 3);
+        }
+        img[(size_t)y * width + x] = (unsigned char)v;
+        isolated.push_back((size_t)y * width + x);
+    }
+    int simd = sdfSetSimdLevel(SDF_SIMD_AVX2), failures = 0;
+    ReferenceCoverage(ref.data(), width, img.data(), width, height, width);
+    for (int level = SDF_SIMD_NONE; level <= simd; level++)
+    {
+        sdfSetSimdLevel(level);
+        sdfCoverageToDistanceField(out.data(), width, img.data(), width, height, width);
+        // The reference rounds some bytes down a step on the way through the distance.
+        failures += CountMismatches(ref, out, width, 1, isolated, "isolated pixels, simd level " + std::to_string(level));
+        if (level == SDF_SIMD_NONE)
+            scalar = out;
+        else
+            failures += CountMismatches(scalar, out, width, 0, {}, "isolated pixels, simd level " + std::to_string(level));
+    }
+
+    // The SIMD rows give the scalar bytes on the bench inputs, at a size that leaves tails.
+    SDFcontext *ctx = sdfCreateContext(1, 0);
+    for (const char *input : {"circles", "text", "noise", "dots"})
+    {
+        const int n = 333;
+        std::vector<unsigned char> mask;
+        MakeInput(input, n, mask);
+        scalar.resize(mask.size());
+        out.resize(mask.size());
+        for (float radius : {SDF_COVERAGE_RADIUS, 4.0f})
+        {
+            sdfSetSimdLevel(SDF_SIMD_NONE);
+            sdfContextCoverageToDistanceField(ctx, scalar.data(), n, 1, radius, radius, mask.data(), n, n, n, 1, 1);
+            for (int level = SDF_SIMD_SSE2; level <= simd; level++)
+            {
+                sdfSetSimdLevel(level);
+                sdfContextCoverageToDistanceField(ctx, out.data(), n, 1, radius, radius, mask.data(), n, n, n, 1, 1);
+                failures += CountMismatches(scalar, out, n, 0, {}, std::string(input) + ", simd level " + std::to_string(level));
+            }
+        }
+    }
+    sdfDeleteContext(ctx);
+    sdfSetSimdLevel(simd);
+    printf("coverage check: %d mismatching pixels\n", failures);
+    return failures;
+}
+
+// Unsigned distance of every pixel to the nearest contour point of the pre-pass, searched exhaustively in
+// rings of grid cells around the pixel until no nearer point can be left, and up to 'reach' pixels.
+static void ReferenceDistances(std::vector<unsigned char> const &img, int n, unsigned char *temp, float reach,
+                               std::vector<float> &ref)
+{
+    const int cell = 4;
+    size_t npix = (size_t)n * n;
+    SDFdist *tdist = (SDFdist *)&temp[0];
+    struct SDFseed *tpt = (struct SDFseed *)&temp[npix * sizeof(SDFdist)];
+    unsigned char *linetemp = &temp[sdf__pixelTempSize(npix, SDF_ENGINE_8SSEDT)];
+    int coff[1] = {0}, cells = (n + cell - 1) / cell;
+    sdf__findEdges(tpt, tdist, img.data(), n, n, n, 1, coff, 1, 0, 0, 0, n, linetemp);
+
+    // The points bucketed by the cell of their pixel.
+    std::vector<int> start((size_t)cells * cells + 1, 0);
+    std::vector<SDFpoint> points;
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            if (sdf__seedValid(&tpt[(size_t)y * n + x]))
+                start[(size_t)(y / cell) * cells + x / cell + 1]++;
+        }
+    }
+    for (size_t c = 1; c < start.size(); c++)
+        start[c] += start[c - 1];
+    points.resize(start.back());
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            if (sdf__seedValid(&tpt[(size_t)y * n + x]))
+                points[fill[(size_t)(y / cell) * cells + x / cell]++] = sdf__seedPoint(&tpt[(size_t)y * n + x], x, y);
+        }
+    }
+
+    ref.resize(npix);
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            SDFpoint p = {(float)x, (float)y};
+            float best = reach * reach;
+            int cx = x / cell, cy = y / cell;
+            // The points of ring k are more than (k - 1) * cell pixels away.
+            for (int k = 0; (float)((k - 1) * cell) * ((k - 1) * cell) < best || k <= 1; k++)
+            {
+                for (int j = cy - k; j <= cy + k; j++)
+                {
+                    if (j < 0 || j >= cells)
+                        continue;
+                    for (int i = cx - k; i <= cx + k; i += (j == cy - k || j == cy + k) ? 1 : 2 * k)
+                    {
+                        if (i >= 0 && i < cells)
+                        {
+                            size_t c = (size_t)j * cells + i;
+                            for (int q = start[c]; q < start[c + 1]; q++)
+                            {
+                                float dx = points[q].x - p.x, dy = points[q].y - p.y, d = dx * dx + dy * dy;
+                                best = d < best ? d : best;
+                            }
+                        }
+                        if (k == 0)
+                            break;
+                    }
+                }
+                if (k > cells)
+                    break;
+            }
+            ref[(size_t)y * n + x] = sqrtf(best);
+        }
+    }
+}
+
+// Error of the signed distances 'field' at 'radius' against the reference, over the inner pixels.
+static void FieldError(std::vector<unsigned char> const &img, int n, std::vector<float> const &ref,
+                       std::vector<float> const &field, float radius, BenchResult *r)
+{
+    double max_error = 0, sum = 0;
+    for (int y = 1; y < n - 1; y++)
+    {
+        for (int x = 1; x < n - 1; x++)
+        {
+            size_t i = (size_t)y * n + x;
+            float d = ref[i] < radius ? ref[i] : radius;
+            double e = fabs((img[i] > 127 ? d : -d) - field[i]);
+            max_error = e > max_error ? e : max_error;
+            sum += e * e;
+        }
+    }
+    r->radius = radius;
+    r->max_error = max_error;
+    r->rms_error = sqrt(sum / ((double)(n - 2) * (n - 2)));
+}
+
+static void ReportQuality(std::vector<BenchResult> &results, BenchResult const &r)
+{
+    printf("%-8s %6d  %-19s r %5.3f %9.3f ns/px   max %7.4f px   rms %7.4f px\n", r.input.c_str(), r.size,
+           r.phase.c_str(), r.radius, r.ns_per_pixel, r.max_error, r.rms_error);
+    results.push_back(r);
+}
+
+// Every engine at 'radius', fastest of the repetitions, and its error.
+static void BenchQuality(std::vector<BenchResult> &results, std::string const &input, int n,
+                         std::vector<unsigned char> const &img, std::vector<float> const &ref, float radius, double min_time)
+{
+    static const struct
+    {
+        const char *name;
+        int engine, flags;
+    } engines[] = {
+        {"8ssedt", SDF_ENGINE_8SSEDT, 0},
+        {"8ssedt_band", SDF_ENGINE_8SSEDT, SDF_CONTEXT_NARROW_BAND},
+        {"8ssedt_adaptive", SDF_ENGINE_8SSEDT_ADAPTIVE, 0},
+        {"exact", SDF_ENGINE_EXACT, 0},
+        {"exact_band", SDF_ENGINE_EXACT, SDF_CONTEXT_NARROW_BAND},
+    };
+    std::vector<float> field((size_t)n * n);
+    for (auto const &e : engines)
+    {
+        SDFcontext *ctx = sdfCreateContext(1, e.flags);
+        if (ctx == NULL)
+            return;
+        double best = 1e30, total = 0;
+        for (int rep = 0; rep == 0 || total < min_time; rep++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            sdfContextBuildFloat(ctx, field.data(), n, 1, radius, radius, img.data(), n, n, n, 1, 1, e.engine);
+            double t = Seconds(start);
+            best = t < best ? t : best;
+            total += t;
+        }
+        sdfDeleteContext(ctx);
+        BenchResult r = {input, e.name, n, best * 1e9 / ((double)n * n), 0.0, -1};
+        FieldError(img, n, ref, field, radius, &r);
+        ReportQuality(results, r);
+    }
+
+    // The coverage estimate has a fixed radius, its bytes are 0.5 + d / sqrt(2).
+    if (radius != SDF_SQRT2 * 0.5f)
+        return;
+    std::vector<unsigned char> bytes((size_t)n * n);
+    double best = 1e30, total = 0;
+    for (int rep = 0; rep == 0 || total < min_time; rep++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        sdfCoverageToDistanceField(bytes.data(), n, img.data(), n, n, n);
+        double t = Seconds(start);
+        best = t < best ? t : best;
+        total += t;
+    }
+    for (size_t i = 0; i < bytes.size(); i++)
+        field[i] = (bytes[i] / 255.0f - 0.5f) * SDF_SQRT2;
+    BenchResult r = {input, "coverage", n, best * 1e9 / ((double)n * n), 0.0, -1};
+    FieldError(img, n, ref, field, radius, &r);
+    ReportQuality(results, r);
+}
+
+static std::vector<std::string> Split(std::string const &text)
+{
+    std::vector<std::string> items;
+    size_t start = 0, end;
+    while ((end = text.find(',', start)) != std::string::npos)
+    {
+        items.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    items.push_back(text.substr(start));
+    return items;
+}
+
+static bool WriteJson(std::string const &path, std::vector<BenchResult> const &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL)
+        return false;
+#ifdef SDF_COMPACT_SCRATCH
+    int compact = 1;
+#else
+    int compact = 0;
+#endif
+    fprintf(fp, "{\n  \"radius\": %g,\n  \"compact_scratch\": %s,\n  \"simd\": %d,\n  \"results\": [", BENCH_RADIUS,
+            compact ? "true" : "false", sdfSetSimdLevel(SDF_SIMD_AVX2));
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        BenchResult const &r = results[i];
+        fprintf(fp, "%s\n    {\"input\": \"%s\", \"size\": %d, \"phase\": \"%s\", \"ns_per_pixel\": %.4f",
+                i > 0 ? "," : "", r.input.c_str(), r.size, r.phase.c_str(), r.ns_per_pixel);
+        if (r.max_error >= 0.0)
+            fprintf(fp, ", \"radius\": %.4f, \"max_error\": %.5f, \"rms_error\": %.5f", r.radius, r.max_error, r.rms_error);
+        else
+            fprintf(fp, ", \"gb_per_s\": %.4f", r.gb_per_s);
+        if (r.allocations >= 0)
+            fprintf(fp, ", \"allocations\": %d", r.allocations);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    return fclose(fp) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> inputs = {"circles", "text", "noise", "dots", "solid", "empty"};
+    std::vector<int> sizes = {64, 256, 1024, 4096};
+    double min_time = 0.2;
+    size_t max_mb = 4096;
+    bool quality = false, check = false, sized = false;
+    std::string json;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--sizes" && has_value)
+        {
+            sizes.clear();
+            sized = true;
+            for (std::string const &s : Split(argv[++i]))
+                sizes.push_back(atoi(s.c_str()));
+        }
+        else if (arg == "--inputs" && has_value)
+            inputs = Split(argv[++i]);
+        else if (arg == "--min-time" && has_value)
+            min_time = atof(argv[++i]);
+        else if (arg == "--max-mb" && has_value)
+            max_mb = (size_t)atoi(argv[++i]);
+        else if (arg == "--json" && has_value)
+            json = argv[++i];
+        else if (arg == "--quality")
+            quality = true;
+        else if (arg == "--check")
+            check = true;
+        else
+        {
+            fprintf(stderr, "usage: sdf_bench [--quality | --check] [--sizes 64,256,...] [--inputs circles,text,noise,dots,solid,empty]\n"
+                            "                 [--min-time S] [--max-mb N] [--json FILE]\n");
+            return 1;
+        }
+    }
+    if (check)
+        return CheckCoverage() == 0 ? 0 : 1;
+    // The reference search is far slower than the engines.
+    if (quality && !sized)
+        sizes = {256, 1024};
+
+    std::vector<BenchResult> results;
+    std::vector<unsigned char> img, out;
+    for (int n : sizes)
+    {
+        if (n < 4)
+        {
+            fprintf(stderr, "sdf_bench: bad size %d\n", n);
+            return 1;
+        }
+        // The phases and the builds hold their temp memory one after the other, never together, and the
+        // exact engine needs the most. The quality runs add the reference and the float field.
+        size_t temp_size = sdf__tempSize(n, n, 1, 1, SDF_ENGINE_EXACT);
+        if ((temp_size + (quality ? 12 : 2) * (size_t)n * n) >> 20 > max_mb)
+        {
+            printf("%6d: skipped, needs more than --max-mb %zu MB\n", n, max_mb);
+            continue;
+        }
+        out.resize((size_t)n * n);
+        for (std::string const &input : inputs)
+        {
+            if (!MakeInput(input, n, img))
+            {
+                fprintf(stderr, "sdf_bench: unknown input %s\n", input.c_str());
+                return 1;
+            }
+            unsigned char *temp = (unsigned char *)malloc(temp_size);
+            if (temp == NULL)
+            {
+                printf("%6d: skipped, out of memory\n", n);
+                break;
+            }
+            if (quality)
+            {
+                std::vector<float> ref;
+                ReferenceDistances(img, n, temp, BENCH_RADIUS, ref);
+                free(temp);
+                BenchQuality(results, input, n, img, ref, BENCH_RADIUS, min_time);
+                BenchQuality(results, input, n, img, ref, SDF_SQRT2 * 0.5f, min_time);
+                continue;
+            }
+            BenchPhases(results, input, n, img, temp, out.data(), min_time);
+            free(temp);
+            BenchBuild(results, input, n, img, out.data(), "build", SDF_ENGINE_8SSEDT, 0, min_time);
+            BenchBuild(results, input, n, img, out.data(), "build_band", SDF_ENGINE_8SSEDT, SDF_CONTEXT_NARROW_BAND, min_time);
+            BenchBuild(results, input, n, img, out.data(), "build_adaptive", SDF_ENGINE_8SSEDT_ADAPTIVE, 0, min_time);
+            BenchBuild(results, input, n, img, out.data(), "build_adaptive_band", SDF_ENGINE_8SSEDT_ADAPTIVE,
+                       SDF_CONTEXT_NARROW_BAND, min_time);
+            BenchBuild(results, input, n, img, out.data(), "build_exact", SDF_ENGINE_EXACT, 0, min_time);
+            BenchBuild(results, input, n, img, out.data(), "build_exact_band", SDF_ENGINE_EXACT, SDF_CONTEXT_NARROW_BAND, min_time);
+            BenchCoverage(results, input, n, img, out.data(), min_time);
+            BenchRemapCached(results, input, n, img, out.data(), min_time);
+        }
+    }
+    if (!json.empty() && !WriteJson(json, results))
+    {
+        fprintf(stderr, "sdf_bench: cannot write %s\n", json.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+// Sprite atlases. The sizes of all the masks are read from the file headers and packed at once with
+// stb_rect_pack, each padded by the outside radius so that the fields of neighbours do not bleed into
+// each other, into as many pages as they need. Then every mask is loaded and baked straight into its
+// rectangle as a task on the work-stealing pool, one single threaded context per worker, so the run
+// takes about as long as the bakes spread over the cores and nothing goes through disk in between.
+//
+// The UVs go next to the atlas as .json: the pages, then per sprite its page, the padded rectangle in
+// pixels and the UVs of the mask itself inside it.
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <filesystem>
+
+#include "sdfbake.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "stb_rect_pack.h"
+
+namespace fs = std::filesystem;
+
+struct AtlasSprite
+{
+    std::string input;
+    int width = 0, height = 0, comp = 0; // Of the mask.
+    int page = -1, x = 0, y = 0;         // Padded rectangle.
+};
+
+struct AtlasPage
+{
+    int width = 0, height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+// Fills pages of at most 'size' x 'size' until every rectangle is placed, each page trimmed to the rows
+// it uses.
+static bool PackSprites(std::vector<AtlasSprite> *sprites, int pad, int size, std::vector<AtlasPage> *pages)
+{
+    std::vector<stbrp_rect> left;
+    for (size_t i = 0; i < sprites->size(); i++)
+    {
+        AtlasSprite const &s = (*sprites)[i];
+        if (s.width + 2 * pad > size || s.height + 2 * pad > size)
+        {
+            Error(s.input + " does not fit a " + std::to_string(size) + " atlas");
+            return false;
+        }
+        stbrp_rect r = {};
+        r.id = (int)i;
+        r.w = s.width + 2 * pad;
+        r.h = s.height + 2 * pad;
+        left.push_back(r);
+    }
+    std::vector<stbrp_node> nodes(size);
+    while (!left.empty())
+    {
+        stbrp_context packer;
+        stbrp_init_target(&packer, size, size, nodes.data(), size);
+        stbrp_pack_rects(&packer, left.data(), (int)left.size());
+        AtlasPage page;
+        std::vector<stbrp_rect> next;
+        for (stbrp_rect const &r : left)
+        {
+            if (!r.was_packed)
+            {
+                next.push_back(r);
+                continue;
+            }
+            AtlasSprite &s = (*sprites)[r.id];
+            s.page = (int)pages->size();
+            s.x = r.x;
+            s.y = r.y;
+            page.width = std::max(page.width, r.x + r.w);
+            page.height = std::max(page.height, r.y + r.h);
+        }
+        page.width = (page.width + 3) & ~3;
+        page.height = (page.height + 3) & ~3;
+        pages->push_back(std::move(page));
+        left.swap(next);
+    }
+    return true;
+}
+
+static std::string PagePath(std::string const &output, int page, int pages)
+{
+    if (pages == 1)
+        return output;
+    fs::path path(output);
+    return (path.parent_path() / (path.stem().string() + "_" + std::to_string(page) + path.extension().string())).string();
+}
+
+int RunAtlas(BakeOptions const &opts, std::string const &input, std::string const &output)
+{
+    std::vector<std::string> files;
+    if (!ListInputs(input, &files))
+        return Error("cannot list " + input);
+
+    auto atlasStart = std::chrono::steady_clock::now();
+    std::vector<AtlasSprite> sprites(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        sprites[i].input = files[i];
+        if (!ImageInfo(files[i], &sprites[i].width, &sprites[i].height, &sprites[i].comp))
+            return 1;
+    }
+    int pad = (int)ceilf(opts.outside_radius) + 1;
+    std::vector<AtlasPage> pages;
+    if (!PackSprites(&sprites, pad, opts.atlas_size, &pages))
+        return 1;
+    for (AtlasPage &page : pages)
+        page.pixels.assign((size_t)page.width * page.height, 0);
+
+    TaskPool pool(opts.threads);
+    std::vector<SDFcontext *> contexts(pool.Workers(), nullptr);
+    std::vector<std::vector<unsigned char>> masks(pool.Workers());
+    for (SDFcontext *&ctx : contexts)
+    {
+        ctx = sdfCreateContext(1, SDF_CONTEXT_HUGE_PAGES | (opts.narrow_band ? SDF_CONTEXT_NARROW_BAND : 0));
+        if (ctx == nullptr)
+        {
+            for (SDFcontext *created : contexts)
+                sdfDeleteContext(created);
+            return Error("out of memory");
+        }
+    }
+    std::atomic<int> failed{0};
+    for (AtlasSprite const &s : sprites)
+    {
+        const AtlasSprite *sprite = &s;
+        pool.Spawn([&, sprite](int worker) {
+            int width, height, comp;
+            unsigned char *data;
+            {
+                TraceScope span(opts.trace, "load", "file", TraceArg("file", sprite->input));
+                data = LoadImage(sprite->input, &width, &height, &comp);
+            }
+            if (data == nullptr || width != sprite->width || height != sprite->height)
+            {
+                if (data != nullptr)
+                    Error(sprite->input + " changed while baking");
+                FreeImage(data);
+                failed++;
+                return;
+            }
+            // The mask is the last selected channel, alpha by default.
+            int channels = ChannelsForComp(opts.channels, comp), channel = 0;
+            for (int c = 0; c < comp; c++)
+            {
+                if (channels & (1 << c))
+                    channel = c;
+            }
+            int w = width + 2 * pad, h = height + 2 * pad;
+            std::vector<unsigned char> &mask = masks[worker];
+            mask.assign((size_t)w * h, 0);
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                    mask[(size_t)(y + pad) * w + x + pad] = data[((size_t)y * width + x) * comp + channel];
+            }
+            FreeImage(data);
+            AtlasPage &page = pages[sprite->page];
+            std::string args = TraceArg("file", sprite->input) + ", " + TraceArg("page", sprite->page);
+            TraceScope span(opts.trace, "bake", "file", args);
+            TraceBuilds builds(opts.trace, contexts[worker], args);
+            if (!BuildChannels(contexts[worker], opts, &page.pixels[(size_t)sprite->y * page.width + sprite->x], page.width, 1,
+                               mask.data(), w, h, w, 1, 1))
+            {
+                Error("bake failed: " + sprite->input);
+                failed++;
+            }
+        });
+    }
+    pool.Wait();
+    for (SDFcontext *ctx : contexts)
+        sdfDeleteContext(ctx);
+    if (failed > 0)
+        return 1;
+
+    std::string json = "{\n  \"pad\": " + std::to_string(pad) + ",\n  \"pages\": [";
+    for (size_t p = 0; p < pages.size(); p++)
+    {
+        std::string path = PagePath(output, (int)p, (int)pages.size());
+        if (!WriteImage(path, pages[p].width, pages[p].height, 1, SDF_FORMAT_UNORM8, 1, pages[p].pixels.data()))
+            return 1;
+        json += std::string(p > 0 ? ",\n" : "\n") + "    {\"file\": " + JsonQuote(fs::path(path).filename().string()) +
+                ", \"width\": " + std::to_string(pages[p].width) + ", \"height\": " + std::to_string(pages[p].height) + "}";
+    }
+    json += "\n  ],\n  \"sprites\": [";
+    for (size_t i = 0; i < sprites.size(); i++)
+    {
+        AtlasSprite const &s = sprites[i];
+        AtlasPage const &page = pages[s.page];
+        char uv[160];
+        snprintf(uv, sizeof(uv), "\"uv\": [%.8g, %.8g, %.8g, %.8g]", (double)(s.x + pad) / page.width,
+                 (double)(s.y + pad) / page.height, (double)(s.x + pad + s.width) / page.width,
+                 (double)(s.y + pad + s.height) / page.height);
+        json += std::string(i > 0 ? ",\n" : "\n") + "    {\"name\": " + JsonQuote(fs::path(s.input).filename().string()) +
+                ", \"page\": " + std::to_string(s.page) + ", \"x\": " + std::to_string(s.x) + ", \"y\": " +
+                std::to_string(s.y) + ", \"width\": " + std::to_string(s.width + 2 * pad) + ", \"height\": " +
+                std::to_string(s.height + 2 * pad) + ", " + uv + "}";
+    }
+    json += "\n  ]\n}\n";
+    if (!WriteBytes(fs::path(output).replace_extension(".json").string(), json.data(), json.size()))
+        return 1;
+
+    auto atlasTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - atlasStart).count();
+    Log(opts, "Atlas: " + std::to_string(sprites.size()) + " sprites, " + std::to_string(pages.size()) + " pages, " +
+                  std::to_string(atlasTime) + " s, " + std::to_string(pool.Workers()) + " workers");
+    return 0;
+}
@@ -0,0 +1,241 @@
+// Batch baking. Every image is a chain of tasks on the work-stealing pool: the load, then one transform
+// task per selected channel, then the encode once the last channel is done. The channels of an image
+// are baked in place on the shared pixels, each task only touches the bytes of its own channel.
+// Every worker keeps a single threaded SDF context, so after the first images the bakes don't allocate.
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "sdfbake.h"
+#include "scheduler.h"
+#include "cache.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+
+struct BatchImage
+{
+    std::string input, output;
+    unsigned char *data = nullptr;
+    unsigned char *samples = nullptr; // Baked samples of the formats wider than a byte, 'data' stays the input.
+    int width = 0, height = 0, comp = 0;
+    uint64_t key = 0; // Bake cache key.
+    std::atomic<int> channels_left{0};
+    std::atomic<bool> failed{false};
+};
+
+struct BatchStats
+{
+    std::atomic<int> done{0}, cached{0}, failed{0};
+    std::atomic<long long> pixels{0};
+};
+
+static bool IsImagePath(fs::path const &path)
+{
+    static const char *const extensions[] = {".png", ".tga", ".bmp", ".jpg", ".jpeg", ".psd", ".gif", ".pgm", ".ppm"};
+    std::string ext = to_lower(path.extension().string());
+    for (const char *e : extensions)
+    {
+        if (ext == e)
+            return true;
+    }
+    return false;
+}
+
+// The directory listing is sorted so that the runs are repeatable.
+bool ListInputs(std::string const &input, std::vector<std::string> *files)
+{
+    std::error_code ec;
+    if (fs::is_directory(input, ec))
+    {
+        for (fs::directory_iterator it(input, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (it->is_regular_file(ec) && IsImagePath(it->path()))
+                files->push_back(it->path().string());
+        }
+        std::sort(files->begin(), files->end());
+        return !ec;
+    }
+    std::ifstream list(input);
+    if (!list)
+        return false;
+    std::string line;
+    while (std::getline(list, line))
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+        size_t last = line.find_last_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        files->push_back(line.substr(first, last - first + 1));
+    }
+    return true;
+}
+
+bool CreateOutputDir(std::string const &outdir)
+{
+    std::error_code ec;
+    fs::create_directories(outdir, ec);
+    return fs::is_directory(outdir, ec);
+}
+
+std::string OutputPath(std::string const &outdir, std::string const &input, BakeOptions const &opts)
+{
+    fs::path output = fs::path(outdir) / fs::path(input).filename();
+    if (opts.mips || opts.format == SDFBAKE_FORMAT_BC)
+        output.replace_extension(".dds");
+    else if (!CanWriteImage(output.string(), opts.format))
+        output.replace_extension(opts.format == SDF_FORMAT_HALF || opts.format == SDF_FORMAT_FLOAT ? ".exr" : ".png");
+    return output.string();
+}
+
+static void Encode(BakeOptions const &opts, BatchImage *image, BakeCache *cache, BatchStats *stats)
+{
+    TraceScope span(opts.trace, "encode", "file", TraceArg("file", image->output));
+    bool ok = !image->failed && WriteBaked(cache, image->key, opts, image->output, image->width, image->height, image->comp,
+                                           image->samples != nullptr ? image->samples : image->data);
+    FreeImage(image->data);
+    FreeImage(image->samples);
+    image->data = image->samples = nullptr;
+    if (ok)
+    {
+        stats->done++;
+        stats->pixels += (long long)image->width * image->height;
+    }
+    else
+    {
+        stats->failed++;
+    }
+}
+
+int RunBatch(BakeOptions const &opts, BakeCache *cache, std::string const &input, std::string const &outdir)
+{
+    std::vector<std::string> files;
+    if (!ListInputs(input, &files))
+        return Error("cannot list " + input);
+    if (!CreateOutputDir(outdir))
+        return Error("cannot create " + outdir);
+
+    auto batchStart = std::chrono::steady_clock::now();
+    TaskPool pool(opts.threads);
+    std::vector<SDFcontext *> contexts(pool.Workers(), nullptr);
+    for (SDFcontext *&ctx : contexts)
+    {
+        ctx = sdfCreateContext(1, SDF_CONTEXT_HUGE_PAGES | (opts.narrow_band ? SDF_CONTEXT_NARROW_BAND : 0));
+        if (ctx == nullptr)
+        {
+            for (SDFcontext *created : contexts)
+                sdfDeleteContext(created);
+            return Error("out of memory");
+        }
+    }
+
+    std::vector<std::unique_ptr<BatchImage>> images;
+    BatchStats stats;
+    images.reserve(files.size());
+    for (std::string const &file : files)
+    {
+        images.emplace_back(new BatchImage);
+        BatchImage *image = images.back().get();
+        image->input = file;
+        image->output = OutputPath(outdir, file, opts);
+
+        pool.Spawn([&, image](int worker) {
+            {
+                TraceScope span(opts.trace, "load", "file", TraceArg("file", image->input));
+                image->data = LoadImage(image->input, &image->width, &image->height, &image->comp);
+            }
+            if (image->data == nullptr)
+            {
+                stats.failed++;
+                return;
+            }
+            if (FetchBaked(cache, opts, image->data, image->width, image->height, image->comp, image->output, &image->key))
+            {
+                FreeImage(image->data);
+                image->data = nullptr;
+                stats.cached++;
+                return;
+            }
+            if (opts.supersample > 1 || opts.format == SDFBAKE_FORMAT_BC || opts.mips)
+            {
+                // The resizes and the BC5 blocks need all the channels at once, the image stays one task.
+                if (!TracedBakeImage(contexts[worker], opts, image->input, &image->data, &image->width, &image->height,
+                                     &image->comp))
+                {
+                    Error("bake failed: " + image->input);
+                    image->failed = true;
+                }
+                Encode(opts, image, cache, &stats);
+                return;
+            }
+            int channels = ChannelsForComp(opts.channels, image->comp);
+            int count = 0;
+            for (int c = 0; c < 4; c++)
+                count += (channels >> c) & 1;
+            if (opts.format != SDF_FORMAT_UNORM8)
+            {
+                image->samples = WidenImage(image->data, image->width, image->height, image->comp, channels, opts.format);
+                if (image->samples == nullptr)
+                {
+                    Error("out of memory: " + image->input);
+                    image->failed = true;
+                    count = 0;
+                }
+            }
+            if (count == 0)
+            {
+                Encode(opts, image, cache, &stats);
+                return;
+            }
+            image->channels_left = count;
+            for (int c = 0; c < 4; c++)
+            {
+                if ((channels & (1 << c)) == 0)
+                    continue;
+                pool.Spawn([&, image, c](int worker) {
+                    int stride = image->width * image->comp;
+                    void *out = image->samples != nullptr ? (void *)image->samples : image->data;
+                    std::string args = TraceArg("file", image->input) + ", " + TraceArg("channel", c);
+                    {
+                        TraceScope span(opts.trace, "channel", "channel", args);
+                        TraceBuilds builds(opts.trace, contexts[worker], args);
+                        bool ok = opts.format == SDF_FORMAT_UNORM8
+                                      ? BuildChannels(contexts[worker], opts, image->data, stride, image->comp, image->data,
+                                                      image->width, image->height, stride, image->comp, 1 << c)
+                                      : sdfContextBuildFormat(contexts[worker], out, stride, image->comp, opts.format,
+                                                              opts.outside_radius, opts.inside_radius, image->data,
+                                                              image->width, image->height, stride, image->comp, 1 << c,
+                                                              opts.engine) != 0;
+                        if (!ok)
+                        {
+                            Error("bake failed: " + image->input);
+                            image->failed = true;
+                        }
+                    }
+                    if (--image->channels_left == 0)
+                        pool.Spawn([&, image](int) { Encode(opts, image, cache, &stats); }, worker);
+                }, worker);
+            }
+        });
+    }
+    pool.Wait();
+
+    size_t scratch = 0;
+    for (SDFcontext *ctx : contexts)
+    {
+        scratch += sdfContextPeakScratch(ctx);
+        sdfDeleteContext(ctx);
+    }
+    auto batchTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    Log(opts, "Batch: " + std::to_string(stats.done.load()) + " baked, " + std::to_string(stats.cached.load()) + " cached, " +
+                  std::to_string(stats.failed.load()) + " failed, " +
+                  std::to_string(batchTime) + " s, " + std::to_string(stats.pixels.load() / 1e6 / batchTime) + " Mpx/s, " +
+                  std::to_string(pool.Workers()) + " workers, " + std::to_string(pool.Steals()) + " steals, scratch " +
+                  std::to_string(scratch >> 10) + " KB");
+    return stats.failed.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+
+namespace fs = std::filesystem;
+
+// Bumped whenever the transform changes its output, so that older entries stop matching.
+#define SDFBAKE_CACHE_VERSION 4
+
+static const uint64_t XXH_PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t XXH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t XXH_PRIME3 = 0x165667B19E3779F9ull;
+static const uint64_t XXH_PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t XXH_PRIME5 = 0x27D4EB2F165667C5ull;
+
+static uint64_t Rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t Read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint32_t Read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t XxhRound(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME2;
+    return Rotl64(acc, 31) * XXH_PRIME1;
+}
+
+static uint64_t XxhMerge(uint64_t acc, uint64_t val)
+{
+    acc ^= XxhRound(0, val);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)data, *end = p + size;
+    uint64_t h;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2, v2 = seed + XXH_PRIME2, v3 = seed, v4 = seed - XXH_PRIME1;
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = XxhRound(v1, Read64(p));
+            v2 = XxhRound(v2, Read64(p + 8));
+            v3 = XxhRound(v3, Read64(p + 16));
+            v4 = XxhRound(v4, Read64(p + 24));
+        }
+        h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+        h = XxhMerge(XxhMerge(XxhMerge(XxhMerge(h, v1), v2), v3), v4);
+    }
+    else
+    {
+        h = seed + XXH_PRIME5;
+    }
+    h += size;
+    for (; p + 8 <= end; p += 8)
+        h = Rotl64(h ^ XxhRound(0, Read64(p)), 27) * XXH_PRIME1 + XXH_PRIME4;
+    if (p + 4 <= end)
+    {
+        h = Rotl64(h ^ (Read32(p) * XXH_PRIME1), 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = Rotl64(h ^ (*p * XXH_PRIME5), 11) * XXH_PRIME1;
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t BakeKey(BakeOptions const &opts, const unsigned char *pixels, int width, int height, int comp,
+                 std::string const &output)
+{
+    int params[13] = {SDFBAKE_CACHE_VERSION, width, height, comp, ChannelsForComp(opts.channels, comp), opts.engine,
+                      opts.narrow_band ? 1 : 0, 0, 0, 0, opts.supersample, opts.format, opts.mips ? 1 : 0};
+    memcpy(&params[7], &opts.outside_radius, sizeof(float));
+    memcpy(&params[8], &opts.inside_radius, sizeof(float));
+#ifdef SDF_COMPACT_SCRATCH
+    params[9] = 1;
+#endif
+    std::string ext = to_lower(fs::path(output).extension().string());
+    uint64_t h = HashBytes(pixels, (size_t)width * height * comp, 0);
+    h = HashBytes(params, sizeof(params), h);
+    return HashBytes(ext.data(), ext.size(), h);
+}
+
+std::string BakeCache::EntryPath(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.sdfc", (unsigned long long)key);
+    return (fs::path(root) / name).string();
+}
+
+bool BakeCache::Open(std::string const &dir, size_t max_bytes)
+{
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec))
+        return false;
+    root = dir;
+    this->max_bytes = max_bytes;
+
+    // Index the entries, the most recently used first.
+    std::vector<std::pair<fs::file_time_type, uint64_t>> found;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::string name = it->path().filename().string();
+        unsigned long long key;
+        char tail[8];
+        if (name.size() != 21 || sscanf(name.c_str(), "%16llx.%5s", &key, tail) != 2 || strcmp(tail, "sdfc") != 0)
+            continue;
+        size_t size = (size_t)it->file_size(ec);
+        fs::file_time_type time = it->last_write_time(ec);
+        if (ec)
+            continue;
+        found.push_back(std::make_pair(time, (uint64_t)key));
+        entries[key].size = size;
+        bytes += size;
+    }
+    std::sort(found.begin(), found.end(), [](std::pair<fs::file_time_type, uint64_t> const &a,
+                                             std::pair<fs::file_time_type, uint64_t> const &b) { return a.first > b.first; });
+    for (auto const &f : found)
+        entries[f.second].recent = recent.insert(recent.end(), f.second);
+    std::lock_guard<std::mutex> guard(lock);
+    Evict();
+    return true;
+}
+
+void BakeCache::Touch(uint64_t key)
+{
+    Entry &entry = entries[key];
+    recent.erase(entry.recent);
+    entry.recent = recent.insert(recent.begin(), key);
+}
+
+void BakeCache::Evict()
+{
+    while (bytes > max_bytes && !recent.empty())
+    {
+        uint64_t key = recent.back();
+        std::error_code ec;
+        // A fetch may still be reading it; POSIX keeps the data until it is done, Windows refuses
+        // the removal and the file is picked up again by the next run.
+        fs::remove(EntryPath(key), ec);
+        bytes -= entries[key].size;
+        entries.erase(key);
+        recent.pop_back();
+        evictions++;
+    }
+}
+
+// Writes the file at 'path' to 'output' through a read-only mapping, without copying it to a buffer.
+static bool CopyMapped(std::string const &path, std::string const &output)
+{
+    bool ok = false;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+        {
+            const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (view != NULL)
+            {
+                ok = WriteBytes(output, view, (size_t)size.QuadPart);
+                UnmapViewOfFile(view);
+            }
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED)
+        {
+            ok = WriteBytes(output, view, (size_t)st.st_size);
+            munmap(view, (size_t)st.st_size);
+        }
+    }
+    close(fd);
+#endif
+    return ok;
+}
+
+bool BakeCache::Fetch(uint64_t key, std::string const &output)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (entries.find(key) == entries.end())
+        {
+            misses++;
+            return false;
+        }
+        Touch(key);
+    }
+    std::string path = EntryPath(key);
+    if (!CopyMapped(path, output))
+    {
+        misses++;
+        return false;
+    }
+    // Keeps the recency for the next runs.
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    hits++;
+    return true;
+}
+
+void BakeCache::Store(uint64_t key, const void *data, size_t size)
+{
+    // Written aside and renamed, so that a concurrent fetch or an interrupted run never sees half an entry.
+    std::string path = EntryPath(key);
+    std::string temp = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    std::error_code ec;
+    if (!WriteBytes(temp, data, size))
+        return;
+    fs::rename(temp, path, ec);
+    if (ec)
+    {
+        fs::remove(temp, ec);
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = entries.find(key);
+    if (found != entries.end())
+    {
+        bytes -= found->second.size;
+        recent.erase(found->second.recent);
+    }
+    Entry &entry = entries[key];
+    entry.size = size;
+    entry.recent = recent.insert(recent.begin(), key);
+    bytes += size;
+    Evict();
+}
+
+size_t BakeCache::Bytes()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return bytes;
+}
+
+bool FetchBaked(BakeCache *cache, BakeOptions const &opts, const unsigned char *pixels, int width, int height, int comp,
+                std::string const &output, uint64_t *key)
+{
+    *key = 0;
+    if (cache == nullptr || !cache->IsOpen())
+        return false;
+    *key = BakeKey(opts, pixels, width, height, comp, output);
+    return cache->Fetch(*key, output);
+}
+
+bool WriteBaked(BakeCache *cache, uint64_t key, BakeOptions const &opts, std::string const &output, int width, int height,
+                int comp, const void *pixels)
+{
+    std::vector<unsigned char> bytes;
+    if (!EncodeImage(output, width, height, comp, opts.format, MipLevels(opts, width, height), pixels, &bytes) ||
+        !WriteBytes(output, bytes.data(), bytes.size()))
+        return false;
+    if (cache != nullptr && cache->IsOpen())
+        cache->Store(key, bytes.data(), bytes.size());
+    return true;
+}
+
+std::string CacheReport(BakeCache *cache)
+{
+    if (cache == nullptr || !cache->IsOpen())
+        return "cache off";
+    return "cache " + std::to_string(cache->Hits()) + " hits, " + std::to_string(cache->Misses()) + " misses, " +
+           std::to_string(cache->Evictions()) + " evictions, " + std::to_string(cache->Bytes() >> 10) + " KB";
+}
@@ -0,0 +1,78 @@
+// On-disk bake cache of sdfbake.
+//
+// An entry is the encoded output file of one bake, stored under a 64-bit key hashed from the decoded
+// input pixels and every parameter that changes the output. A hit maps the entry and writes the output
+// straight from the mapping, skipping the transform and the encode. The cache is capped in bytes and
+// evicts the least recently used entries; the recency survives runs through the file times.
+
+#ifndef SDFBAKE_CACHE_H
+#define SDFBAKE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "sdfbake.h"
+
+// 64-bit hash of 'size' bytes (xxHash64).
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed);
+
+// Key of the bake of 'pixels' with 'opts' written to 'output' (only its extension counts).
+uint64_t BakeKey(BakeOptions const &opts, const unsigned char *pixels, int width, int height, int comp,
+                 std::string const &output);
+
+class BakeCache
+{
+public:
+    // Opens, or creates, the cache in 'dir', and indexes the entries already there.
+    bool Open(std::string const &dir, size_t max_bytes);
+    bool IsOpen() const { return !root.empty(); }
+
+    // Writes the entry of 'key' to 'output' if there is one. Returns false on a miss.
+    bool Fetch(uint64_t key, std::string const &output);
+
+    // Adds the entry of 'key', evicting the oldest entries past the size cap.
+    void Store(uint64_t key, const void *data, size_t size);
+
+    long long Hits() const { return hits.load(); }
+    long long Misses() const { return misses.load(); }
+    long long Evictions() const { return evictions.load(); }
+    size_t Bytes();
+
+private:
+    struct Entry
+    {
+        size_t size;
+        std::list<uint64_t>::iterator recent;
+    };
+
+    std::string EntryPath(uint64_t key) const;
+    void Touch(uint64_t key); // Needs 'lock'.
+    void Evict();             // Needs 'lock'.
+
+    std::string root;
+    size_t max_bytes = 0, bytes = 0;
+    std::mutex lock;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::list<uint64_t> recent; // Most recently used first.
+    std::atomic<long long> hits{0}, misses{0}, evictions{0};
+};
+
+// Looks the bake of 'pixels', still unbaked, up in 'cache'. On a hit the output is written and true
+// returned; either way *key receives the key to pass to WriteBaked(). 'cache' may be NULL.
+bool FetchBaked(BakeCache *cache, BakeOptions const &opts, const unsigned char *pixels, int width, int height, int comp,
+                std::string const &output, uint64_t *key);
+
+// Encodes and writes the 'pixels' BakeImage() baked with 'opts' to 'output', and stores the file in 'cache'
+// under 'key'.
+bool WriteBaked(BakeCache *cache, uint64_t key, BakeOptions const &opts, std::string const &output, int width, int height,
+                int comp, const void *pixels);
+
+// One line of cache statistics for the logs.
+std::string CacheReport(BakeCache *cache);
+
+#endif // SDFBAKE_CACHE_H
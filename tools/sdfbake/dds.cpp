@@ -0,0 +1,164 @@
+// Block compressed output: one baked channel as BC4, two as BC5, in a .dds file. The blocks of a band of
+// 4 rows are compressed by the build thread that remapped it, as soon as its rows are final, so the
+// compression runs in parallel with the rest of the remap and the field is never read back as a whole.
+// The .dds files also take the bytes uncompressed, and mip chains, see BakeMips().
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdfbake.h"
+#include "stb_dxt.h"
+
+static int BlockBytes(int comp)
+{
+    return comp == 1 ? 8 : 16;
+}
+
+size_t BlocksSize(int width, int height, int comp)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(comp);
+}
+
+// Pixels past the right or bottom edge repeat the last column or row, so that they do not stretch the
+// endpoints of the edge blocks.
+void CompressBlocks(const unsigned char *data, int width, int height, int comp, int channels, unsigned char *blocks,
+                    int y0, int y1)
+{
+    int offsets[2], count = 0;
+    for (int c = 0; c < comp && count < 2; c++)
+    {
+        if (channels & (1 << c))
+            offsets[count++] = c;
+    }
+    int blocks_x = (width + 3) / 4, size = BlockBytes(count);
+    for (int by = y0 / 4; by < (y1 + 3) / 4; by++)
+    {
+        for (int bx = 0; bx < blocks_x; bx++)
+        {
+            unsigned char src[16 * 2];
+            for (int i = 0; i < 16; i++)
+            {
+                int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                x = x < width ? x : width - 1;
+                y = y < height ? y : height - 1;
+                const unsigned char *pixel = data + ((size_t)y * width + x) * comp;
+                for (int c = 0; c < count; c++)
+                    src[i * count + c] = pixel[offsets[c]];
+            }
+            unsigned char *dest = blocks + ((size_t)by * blocks_x + bx) * size;
+            if (count == 1)
+                stb_compress_bc4_block(dest, src);
+            else
+                stb_compress_bc5_block(dest, src);
+        }
+    }
+}
+
+struct BlockBands
+{
+    const unsigned char *data;
+    int width, height, comp, channels;
+    unsigned char *blocks;
+};
+
+// Every range but the last starts and ends on a multiple of 4, see SDFrowsFunc.
+static void CompressBand(void *user, int y0, int y1, int)
+{
+    BlockBands *bands = (BlockBands *)user;
+    CompressBlocks(bands->data, bands->width, bands->height, bands->comp, bands->channels, bands->blocks, y0, y1);
+}
+
+bool BakeBlocks(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int *comp)
+{
+    int channels = ChannelsForComp(opts.channels, *comp), count = 0;
+    for (int c = 0; c < 4; c++)
+        count += (channels >> c) & 1;
+    if (count == 0 || count > 2)
+    {
+        Error("bc needs one or two baked channels");
+        return false;
+    }
+
+    // The resize needs the whole field first, its blocks are compressed afterwards.
+    BakeOptions bytes = opts;
+    bytes.format = SDF_FORMAT_UNORM8;
+    if (opts.supersample > 1 && !BakeSupersampled(ctx, bytes, data, width, height, *comp))
+        return false;
+    BlockBands bands = {*data, *width, *height, *comp, channels, nullptr};
+    bands.blocks = (unsigned char *)malloc(BlocksSize(*width, *height, count));
+    if (bands.blocks == nullptr)
+        return false;
+    bool ok = true;
+    if (opts.supersample > 1)
+    {
+        CompressBlocks(*data, *width, *height, *comp, channels, bands.blocks, 0, *height);
+    }
+    else
+    {
+        int stride = *width * *comp;
+        sdfContextSetRowsCallback(ctx, CompressBand, &bands);
+        ok = BuildChannels(ctx, opts, *data, stride, *comp, *data, *width, *height, stride, *comp, channels);
+        sdfContextSetRowsCallback(ctx, NULL, NULL);
+    }
+    if (!ok)
+    {
+        free(bands.blocks);
+        return false;
+    }
+    // FreeImage() releases the blocks like the stb_image pixels.
+    FreeImage(*data);
+    *data = bands.blocks;
+    *comp = count;
+    return true;
+}
+
+// Legacy header, which every DDS reader takes: the ATI1 and ATI2 FourCCs for BC4 and BC5 unorm, and the
+// bytes as luminance, luminance alpha, RGB or RGBA masks over the pixels in memory order.
+bool EncodeDds(int width, int height, int comp, int format, int levels, const void *data, std::vector<unsigned char> *bytes)
+{
+    static const uint32_t pixel_flags[5] = {0, 0x20000, 0x20001, 0x40, 0x41};
+    static const uint32_t masks[5][4] = {{},
+                                         {0xff, 0, 0, 0},
+                                         {0xff, 0, 0, 0xff00},
+                                         {0xff, 0xff00, 0xff0000, 0},
+                                         {0xff, 0xff00, 0xff0000, 0xff000000}};
+    bool blocks = format == SDFBAKE_FORMAT_BC;
+    size_t size = MipChainSize(width, height, comp, format, levels);
+    uint32_t flags = 0x1 | 0x2 | 0x4 | 0x1000; // Caps, height, width, pixel format.
+    flags |= blocks ? 0x80000 : 0x8;           // Linear size or pitch.
+    flags |= levels > 1 ? 0x20000 : 0;         // Mip count.
+    bytes->clear();
+    bytes->reserve(128 + size);
+    AppendU32(bytes, 0x20534444); // "DDS "
+    AppendU32(bytes, 124);
+    AppendU32(bytes, flags);
+    AppendU32(bytes, (uint32_t)height);
+    AppendU32(bytes, (uint32_t)width);
+    AppendU32(bytes, (uint32_t)(blocks ? BlocksSize(width, height, comp) : (size_t)width * comp));
+    AppendU32(bytes, 0); // Depth.
+    AppendU32(bytes, (uint32_t)levels);
+    for (int i = 0; i < 11; i++)
+        AppendU32(bytes, 0);
+    AppendU32(bytes, 32);
+    if (blocks)
+    {
+        AppendU32(bytes, 0x4); // FourCC.
+        AppendU32(bytes, comp == 1 ? 0x31495441 : 0x32495441); // "ATI1", "ATI2"
+        for (int i = 0; i < 5; i++)
+            AppendU32(bytes, 0); // Bit count and masks.
+    }
+    else
+    {
+        AppendU32(bytes, pixel_flags[comp]);
+        AppendU32(bytes, 0);
+        AppendU32(bytes, (uint32_t)comp * 8);
+        for (int i = 0; i < 4; i++)
+            AppendU32(bytes, masks[comp][i]);
+    }
+    AppendU32(bytes, 0x1000 | (levels > 1 ? 0x400008 : 0)); // Texture, mip map and complex.
+    for (int i = 0; i < 4; i++)
+        AppendU32(bytes, 0);
+    bytes->insert(bytes->end(), (const unsigned char *)data, (const unsigned char *)data + size);
+    return true;
+}
@@ -0,0 +1,246 @@
+// Font atlases. Every glyph of the requested code points is rasterised by stb_truetype to coverage, with
+// the outside radius as padding, and baked by the ext/sdf transform straight into its rectangle of the
+// atlas; the rectangles come from stb_rect_pack. The glyphs are tasks on the work-stealing pool with one
+// single threaded context per worker, like the batch mode, so a full CJK set bakes on all cores instead
+// of searching every edge of a glyph for every pixel as stbtt_GetGlyphSDF() does.
+//
+// The metrics go next to the atlas, as .glyphs: little endian, a header then one record per code point
+// in code point order, all fields 32-bit.
+//   header  "SDFG", version, glyph count, atlas width, atlas height, font size (float), outside and inside
+//           radius (float), ascent, descent, line gap (float, pixels)
+//   glyph   code point, x, y, width, height (atlas rectangle), x and y offset of the rectangle from the pen
+//           on the baseline, y down (float), advance (float)
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+#include "sdfbake.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "stb_rect_pack.h"
+#include "stb_truetype.h"
+
+namespace fs = std::filesystem;
+
+#define FONT_METRICS_VERSION 1
+#define FONT_MAX_ATLAS 16384
+
+struct FontGlyph
+{
+    int glyph = 0;                      // Index in the font.
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0; // Coverage box, pixels from the pen, y down.
+    int x = 0, y = 0, w = 0, h = 0;     // Padded rectangle in the atlas, empty for blank glyphs.
+};
+
+// Comma separated code points and ranges, decimal or 0x hex, e.g. "32-126,0x4e00-0x9fff"; "all" takes
+// every code point. The code points the font does not map are left out.
+static bool ParseChars(std::string const &text, const stbtt_fontinfo *font, std::vector<int> *codepoints)
+{
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(',', start);
+        std::string item = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        start = end == std::string::npos ? text.size() + 1 : end + 1;
+        long first, last;
+        char *rest;
+        if (item == "all")
+        {
+            first = 0;
+            last = 0x10ffff;
+        }
+        else
+        {
+            first = last = strtol(item.c_str(), &rest, 0);
+            if (*rest == '-')
+                last = strtol(rest + 1, &rest, 0);
+            if (rest == item.c_str() || *rest != '\0' || first < 0 || last < first || last > 0x10ffff)
+                return false;
+        }
+        for (long c = first; c <= last; c++)
+        {
+            if (stbtt_FindGlyphIndex(font, (int)c) != 0)
+                codepoints->push_back((int)c);
+        }
+    }
+    std::sort(codepoints->begin(), codepoints->end());
+    codepoints->erase(std::unique(codepoints->begin(), codepoints->end()), codepoints->end());
+    return true;
+}
+
+// Packs the rectangles in the narrowest power of two width they fit, the height is what they take.
+static bool PackGlyphs(std::vector<FontGlyph> *glyphs, int *width, int *height)
+{
+    double area = 0;
+    for (FontGlyph const &g : *glyphs)
+        area += (double)g.w * g.h;
+    int w = 64;
+    while (w < FONT_MAX_ATLAS && (double)w * w < area * 1.1)
+        w *= 2;
+    std::vector<stbrp_rect> rects(glyphs->size());
+    for (; w <= FONT_MAX_ATLAS; w *= 2)
+    {
+        for (size_t i = 0; i < rects.size(); i++)
+        {
+            rects[i].id = (int)i;
+            rects[i].w = (*glyphs)[i].w;
+            rects[i].h = (*glyphs)[i].h;
+        }
+        std::vector<stbrp_node> nodes(w);
+        stbrp_context packer;
+        stbrp_init_target(&packer, w, FONT_MAX_ATLAS, nodes.data(), w);
+        if (!stbrp_pack_rects(&packer, rects.data(), (int)rects.size()))
+            continue;
+        int h = 4;
+        for (stbrp_rect const &r : rects)
+        {
+            FontGlyph &g = (*glyphs)[r.id];
+            g.x = r.x;
+            g.y = r.y;
+            h = std::max(h, r.y + r.h);
+        }
+        *width = w;
+        *height = (h + 3) & ~3;
+        return true;
+    }
+    return false;
+}
+
+static void AppendFloat(std::vector<unsigned char> *bytes, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    AppendU32(bytes, bits);
+}
+
+int RunFont(BakeOptions const &opts, std::string const &input, std::string const &output)
+{
+    std::ifstream file(input, std::ios::binary);
+    std::vector<unsigned char> ttf((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    stbtt_fontinfo font;
+    int offset = ttf.empty() ? -1 : stbtt_GetFontOffsetForIndex(ttf.data(), 0);
+    if (offset < 0 || !stbtt_InitFont(&font, ttf.data(), offset))
+        return Error("cannot load font " + input);
+    std::vector<int> codepoints;
+    if (!ParseChars(opts.font_chars, &font, &codepoints))
+        return Error("bad characters: " + opts.font_chars);
+
+    auto fontStart = std::chrono::steady_clock::now();
+    float scale = stbtt_ScaleForPixelHeight(&font, (float)opts.font_size);
+    int pad = (int)ceilf(opts.outside_radius) + 1;
+
+    // Code points mapped to the same glyph share its rectangle.
+    std::vector<FontGlyph> glyphs;
+    std::vector<int> slots(codepoints.size());
+    std::map<int, int> slot_of_glyph;
+    for (size_t i = 0; i < codepoints.size(); i++)
+    {
+        int glyph = stbtt_FindGlyphIndex(&font, codepoints[i]);
+        auto found = slot_of_glyph.find(glyph);
+        if (found != slot_of_glyph.end())
+        {
+            slots[i] = found->second;
+            continue;
+        }
+        FontGlyph g;
+        g.glyph = glyph;
+        stbtt_GetGlyphBitmapBox(&font, glyph, scale, scale, &g.x0, &g.y0, &g.x1, &g.y1);
+        if (g.x1 > g.x0 && g.y1 > g.y0)
+        {
+            g.w = g.x1 - g.x0 + 2 * pad;
+            g.h = g.y1 - g.y0 + 2 * pad;
+        }
+        slots[i] = slot_of_glyph[glyph] = (int)glyphs.size();
+        glyphs.push_back(g);
+    }
+    int width, height;
+    if (!PackGlyphs(&glyphs, &width, &height))
+        return Error("glyphs do not fit a " + std::to_string(FONT_MAX_ATLAS) + " wide atlas");
+    std::vector<unsigned char> atlas((size_t)width * height, 0);
+
+    TaskPool pool(opts.threads);
+    std::vector<SDFcontext *> contexts(pool.Workers(), nullptr);
+    std::vector<std::vector<unsigned char>> coverage(pool.Workers());
+    for (SDFcontext *&ctx : contexts)
+    {
+        ctx = sdfCreateContext(1, SDF_CONTEXT_HUGE_PAGES | (opts.narrow_band ? SDF_CONTEXT_NARROW_BAND : 0));
+        if (ctx == nullptr)
+        {
+            for (SDFcontext *created : contexts)
+                sdfDeleteContext(created);
+            return Error("out of memory");
+        }
+    }
+    std::atomic<int> failed{0};
+    for (FontGlyph const &g : glyphs)
+    {
+        if (g.w == 0)
+            continue;
+        const FontGlyph *glyph = &g;
+        pool.Spawn([&, glyph](int worker) {
+            std::string args = TraceArg("glyph", glyph->glyph);
+            TraceScope span(opts.trace, "glyph", "glyph", args);
+            TraceBuilds builds(opts.trace, contexts[worker], args);
+            std::vector<unsigned char> &pixels = coverage[worker];
+            pixels.assign((size_t)glyph->w * glyph->h, 0);
+            stbtt_MakeGlyphBitmap(&font, &pixels[(size_t)pad * glyph->w + pad], glyph->x1 - glyph->x0,
+                                  glyph->y1 - glyph->y0, glyph->w, scale, scale, glyph->glyph);
+            if (!BuildChannels(contexts[worker], opts, &atlas[(size_t)glyph->y * width + glyph->x], width, 1, pixels.data(),
+                               glyph->w, glyph->h, glyph->w, 1, 1))
+                failed++;
+        });
+    }
+    pool.Wait();
+    for (SDFcontext *ctx : contexts)
+        sdfDeleteContext(ctx);
+    if (failed > 0)
+        return Error("out of memory");
+
+    int ascent, descent, line_gap;
+    stbtt_GetFontVMetrics(&font, &ascent, &descent, &line_gap);
+    std::vector<unsigned char> metrics = {'S', 'D', 'F', 'G'};
+    AppendU32(&metrics, FONT_METRICS_VERSION);
+    AppendU32(&metrics, (uint32_t)codepoints.size());
+    AppendU32(&metrics, (uint32_t)width);
+    AppendU32(&metrics, (uint32_t)height);
+    AppendFloat(&metrics, (float)opts.font_size);
+    AppendFloat(&metrics, opts.outside_radius);
+    AppendFloat(&metrics, opts.inside_radius);
+    AppendFloat(&metrics, ascent * scale);
+    AppendFloat(&metrics, descent * scale);
+    AppendFloat(&metrics, line_gap * scale);
+    for (size_t i = 0; i < codepoints.size(); i++)
+    {
+        FontGlyph const &g = glyphs[slots[i]];
+        int advance, bearing;
+        stbtt_GetGlyphHMetrics(&font, g.glyph, &advance, &bearing);
+        AppendU32(&metrics, (uint32_t)codepoints[i]);
+        AppendU32(&metrics, (uint32_t)g.x);
+        AppendU32(&metrics, (uint32_t)g.y);
+        AppendU32(&metrics, (uint32_t)g.w);
+        AppendU32(&metrics, (uint32_t)g.h);
+        AppendFloat(&metrics, g.w > 0 ? (float)(g.x0 - pad) : 0.0f);
+        AppendFloat(&metrics, g.w > 0 ? (float)(g.y0 - pad) : 0.0f);
+        AppendFloat(&metrics, advance * scale);
+    }
+    std::string metrics_path = fs::path(output).replace_extension(".glyphs").string();
+    if (!WriteImage(output, width, height, 1, SDF_FORMAT_UNORM8, 1, atlas.data()) ||
+        !WriteBytes(metrics_path, metrics.data(), metrics.size()))
+        return 1;
+
+    auto fontTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - fontStart).count();
+    Log(opts, "Font: " + std::to_string(codepoints.size()) + " code points, " + std::to_string(glyphs.size()) +
+                  " glyphs, " + std::to_string(width) + "x" + std::to_string(height) + " atlas, " +
+                  std::to_string(fontTime) + " s, " + std::to_string(pool.Workers()) + " workers");
+    return 0;
+}
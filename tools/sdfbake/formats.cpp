@@ -0,0 +1,263 @@
+// Writers of the samples wider than a byte, which stb_image_write does not cover: 16-bit .png and .pgm,
+// and the signed distances as half or float .exr (uncompressed scanlines) or float .pfm.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdfbake.h"
+
+// Defined with the stb_image_write implementation, the header part does not declare it.
+extern "C" unsigned char *stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality);
+
+int FormatBytes(int format)
+{
+    switch (format)
+    {
+    case SDF_FORMAT_UNORM8:
+    case SDFBAKE_FORMAT_BC:
+        return 1;
+    case SDF_FORMAT_FLOAT:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+static float Clamp01(float value)
+{
+    return value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+}
+
+void StoreSample(void *data, size_t i, int format, float value, float distance)
+{
+    switch (format)
+    {
+    case SDF_FORMAT_UNORM8:
+        ((unsigned char *)data)[i] = (unsigned char)(Clamp01(value + 0.5f / 255) * 255.0f);
+        break;
+    case SDF_FORMAT_UNORM16:
+        ((uint16_t *)data)[i] = (uint16_t)(Clamp01(value + 0.5f / 65535) * 65535.0f);
+        break;
+    case SDF_FORMAT_HALF:
+        ((uint16_t *)data)[i] = sdfFloatToHalf(distance);
+        break;
+    default:
+        ((float *)data)[i] = distance;
+        break;
+    }
+}
+
+unsigned char *WidenImage(const unsigned char *data, int width, int height, int comp, int channels, int format)
+{
+    size_t count = (size_t)width * height * comp;
+    unsigned char *wide = (unsigned char *)malloc(count * FormatBytes(format));
+    if (wide == nullptr)
+        return nullptr;
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((channels & (1 << (i % comp))) == 0)
+        {
+            float value = data[i] * (1.0f / 255.0f);
+            StoreSample(wide, i, format, value, value);
+        }
+    }
+    return wide;
+}
+
+static void Append(std::vector<unsigned char> *bytes, const void *data, size_t size)
+{
+    bytes->insert(bytes->end(), (const unsigned char *)data, (const unsigned char *)data + size);
+}
+
+static void AppendString(std::vector<unsigned char> *bytes, const char *text)
+{
+    Append(bytes, text, strlen(text) + 1);
+}
+
+// Little endian, like the machines this runs on; EXR and negative scale PFM files are little endian.
+static void AppendBigU32(std::vector<unsigned char> *bytes, uint32_t value)
+{
+    unsigned char be[4] = {(unsigned char)(value >> 24), (unsigned char)(value >> 16), (unsigned char)(value >> 8),
+                           (unsigned char)value};
+    Append(bytes, be, 4);
+}
+
+struct Crc32Table
+{
+    uint32_t entries[256];
+    Crc32Table()
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+static uint32_t Crc32(const unsigned char *data, size_t size)
+{
+    static const Crc32Table table; // Built once, the batch encoders may get here together.
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < size; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+static void AppendPngChunk(std::vector<unsigned char> *bytes, const char *type, const unsigned char *data, size_t size)
+{
+    AppendBigU32(bytes, (uint32_t)size);
+    size_t start = bytes->size();
+    Append(bytes, type, 4);
+    Append(bytes, data, size);
+    AppendBigU32(bytes, Crc32(bytes->data() + start, size + 4));
+}
+
+// 16-bit samples are big endian, each row filtered with Sub, which suits the smooth distance ramps.
+static bool EncodePng16(int width, int height, int comp, const uint16_t *data, std::vector<unsigned char> *bytes)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    static const unsigned char color_types[5] = {0, 0, 4, 2, 6};
+    size_t row = (size_t)width * comp * 2;
+    std::vector<unsigned char> filtered((row + 1) * height);
+    std::vector<unsigned char> line(row);
+    for (int y = 0; y < height; y++)
+    {
+        const uint16_t *src = data + (size_t)y * width * comp;
+        for (size_t i = 0; i < (size_t)width * comp; i++)
+        {
+            line[i * 2] = (unsigned char)(src[i] >> 8);
+            line[i * 2 + 1] = (unsigned char)src[i];
+        }
+        unsigned char *dst = &filtered[(row + 1) * y];
+        dst[0] = 1;
+        for (size_t i = 0; i < row; i++)
+            dst[1 + i] = (unsigned char)(line[i] - (i >= (size_t)comp * 2 ? line[i - comp * 2] : 0));
+    }
+    int zlen;
+    unsigned char *zlib = stbi_zlib_compress(filtered.data(), (int)filtered.size(), &zlen, 8);
+    if (zlib == nullptr)
+        return false;
+
+    unsigned char header[13] = {0};
+    header[8] = 16;
+    header[9] = color_types[comp];
+    for (int i = 0; i < 4; i++)
+    {
+        header[i] = (unsigned char)(width >> (24 - 8 * i));
+        header[4 + i] = (unsigned char)(height >> (24 - 8 * i));
+    }
+    Append(bytes, signature, 8);
+    AppendPngChunk(bytes, "IHDR", header, 13);
+    AppendPngChunk(bytes, "IDAT", zlib, zlen);
+    AppendPngChunk(bytes, "IEND", nullptr, 0);
+    free(zlib);
+    return true;
+}
+
+static bool EncodePgm16(int width, int height, const uint16_t *data, std::vector<unsigned char> *bytes)
+{
+    char header[64];
+    int n = snprintf(header, sizeof(header), "P5\n%d %d\n65535\n", width, height);
+    bytes->assign(header, header + n);
+    for (size_t i = 0; i < (size_t)width * height; i++)
+    {
+        unsigned char be[2] = {(unsigned char)(data[i] >> 8), (unsigned char)data[i]};
+        Append(bytes, be, 2);
+    }
+    return true;
+}
+
+// Rows bottom up; the negative scale marks little endian floats.
+static bool EncodePfm(int width, int height, int comp, const float *data, std::vector<unsigned char> *bytes)
+{
+    char header[64];
+    int n = snprintf(header, sizeof(header), "%s\n%d %d\n-1.0\n", comp == 1 ? "Pf" : "PF", width, height);
+    bytes->assign(header, header + n);
+    for (int y = height - 1; y >= 0; y--)
+        Append(bytes, data + (size_t)y * width * comp, (size_t)width * comp * sizeof(float));
+    return true;
+}
+
+static void AppendExrAttribute(std::vector<unsigned char> *bytes, const char *name, const char *type,
+                               const void *value, size_t size)
+{
+    AppendString(bytes, name);
+    AppendString(bytes, type);
+    AppendU32(bytes, (uint32_t)size);
+    Append(bytes, value, size);
+}
+
+// Single part scanline file without compression. The channels are listed, and stored in each line,
+// in alphabetical order; grey images get a luminance channel.
+static bool EncodeExr(int width, int height, int comp, int format, const void *data, std::vector<unsigned char> *bytes)
+{
+    static const char *const names[5][4] = {{}, {"Y"}, {"A", "Y"}, {"B", "G", "R"}, {"A", "B", "G", "R"}};
+    static const int components[5][4] = {{}, {0}, {1, 0}, {2, 1, 0}, {3, 2, 1, 0}};
+    static const unsigned char magic[8] = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+    int sample = FormatBytes(format);
+
+    bytes->clear();
+    Append(bytes, magic, 8);
+    std::vector<unsigned char> channels;
+    for (int c = 0; c < comp; c++)
+    {
+        AppendString(&channels, names[comp][c]);
+        AppendU32(&channels, format == SDF_FORMAT_HALF ? 1 : 2);
+        AppendU32(&channels, 0); // pLinear and reserved.
+        AppendU32(&channels, 1);
+        AppendU32(&channels, 1);
+    }
+    channels.push_back(0);
+    AppendExrAttribute(bytes, "channels", "chlist", channels.data(), channels.size());
+    unsigned char none = 0, increasing_y = 0;
+    AppendExrAttribute(bytes, "compression", "compression", &none, 1);
+    int32_t window[4] = {0, 0, width - 1, height - 1};
+    AppendExrAttribute(bytes, "dataWindow", "box2i", window, sizeof(window));
+    AppendExrAttribute(bytes, "displayWindow", "box2i", window, sizeof(window));
+    AppendExrAttribute(bytes, "lineOrder", "lineOrder", &increasing_y, 1);
+    float aspect = 1.0f, center[2] = {0.0f, 0.0f};
+    AppendExrAttribute(bytes, "pixelAspectRatio", "float", &aspect, sizeof(aspect));
+    AppendExrAttribute(bytes, "screenWindowCenter", "v2f", center, sizeof(center));
+    AppendExrAttribute(bytes, "screenWindowWidth", "float", &aspect, sizeof(aspect));
+    bytes->push_back(0);
+
+    // One line per block, the offset table comes first.
+    size_t line = (size_t)width * comp * sample;
+    uint64_t offset = bytes->size() + (size_t)height * 8;
+    for (int y = 0; y < height; y++, offset += 8 + line)
+        Append(bytes, &offset, 8);
+    const unsigned char *src = (const unsigned char *)data;
+    for (int y = 0; y < height; y++)
+    {
+        AppendU32(bytes, (uint32_t)y);
+        AppendU32(bytes, (uint32_t)line);
+        for (int c = 0; c < comp; c++)
+        {
+            for (int x = 0; x < width; x++)
+                Append(bytes, src + (((size_t)y * width + x) * comp + components[comp][c]) * sample, sample);
+        }
+    }
+    return true;
+}
+
+bool EncodeWide(std::string const &path, int width, int height, int comp, int format, const void *data,
+                std::vector<unsigned char> *bytes)
+{
+    std::string lower = to_lower(path);
+    bytes->clear();
+    if (format == SDF_FORMAT_UNORM16 && ends_with(lower, ".png"))
+        return EncodePng16(width, height, comp, (const uint16_t *)data, bytes);
+    if (format == SDF_FORMAT_UNORM16 && ends_with(lower, ".pgm") && comp == 1)
+        return EncodePgm16(width, height, (const uint16_t *)data, bytes);
+    if ((format == SDF_FORMAT_HALF || format == SDF_FORMAT_FLOAT) && ends_with(lower, ".exr"))
+        return EncodeExr(width, height, comp, format, data, bytes);
+    if (format == SDF_FORMAT_FLOAT && ends_with(lower, ".pfm") && (comp == 1 || comp == 3))
+        return EncodePfm(width, height, comp, (const float *)data, bytes);
+    Error("cannot write " + path + ": unsupported format");
+    return false;
+}
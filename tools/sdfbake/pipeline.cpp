@@ -0,0 +1,294 @@
+// Pipelined batch baking. Decoding, the distance transform and encoding take comparable time per image,
+// so each stage gets its own threads and they overlap:
+//
+//   files -> decode threads -> [transform queue] -> transform threads -> [encode queue] -> encode threads
+//
+// The queues are bounded, a full queue blocks the stage feeding it. On top of that the decoded images
+// in flight are capped by a byte budget, reserved from the image header before decoding and released
+// after encoding, so the memory stays under the ceiling whatever the mix of sizes. The transform threads
+// keep one SDF context each, their temp memory comes on top of the budget.
+// Every thread counts the time it spends working, which gives the utilisation of each stage.
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "sdfbake.h"
+#include "cache.h"
+#include "trace.h"
+
+struct PipelineImage
+{
+    size_t index;
+    unsigned char *data;
+    int width, height, comp;
+    size_t bytes; // Reserved from the budget.
+    uint64_t key; // Bake cache key.
+};
+
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    // Blocks while the queue is full.
+    void Push(T const &item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        not_full.wait(guard, [&] { return items.size() < capacity; });
+        items.push_back(item);
+        not_empty.notify_one();
+    }
+
+    // Blocks while the queue is empty. Returns false once the queue is closed and drained.
+    bool Pop(T *item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait(guard, [&] { return !items.empty() || closed; });
+        if (items.empty())
+            return false;
+        *item = items.front();
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    // No more pushes, wakes the consumers once the queue is drained.
+    void Close()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable not_full, not_empty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
+
+// Bytes of decoded images in flight. An image larger than the whole budget still goes through, alone.
+class MemoryBudget
+{
+public:
+    explicit MemoryBudget(size_t limit) : limit(limit), used(0), peak(0) {}
+
+    void Acquire(size_t bytes)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        released.wait(guard, [&] { return used == 0 || used + bytes <= limit; });
+        used += bytes;
+        peak = used > peak ? used : peak;
+    }
+
+    void Release(size_t bytes)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        used -= bytes;
+        released.notify_all();
+    }
+
+    size_t Peak()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return peak;
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable released;
+    size_t limit, used, peak;
+};
+
+// Threads of one stage, and the time they spent working.
+struct PipelineStage
+{
+    const char *name;
+    int threads;
+    std::atomic<long long> busy_ns{0};
+    std::atomic<int> running{0};
+};
+
+class StageTimer
+{
+public:
+    explicit StageTimer(PipelineStage *stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~StageTimer()
+    {
+        stage->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    PipelineStage *stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+int RunPipeline(BakeOptions const &opts, BakeCache *cache, std::string const &input, std::string const &outdir)
+{
+    std::vector<std::string> files;
+    if (!ListInputs(input, &files))
+        return Error("cannot list " + input);
+    std::vector<std::string> outputs;
+    for (std::string const &file : files)
+        outputs.push_back(OutputPath(outdir, file, opts));
+    if (!CreateOutputDir(outdir))
+        return Error("cannot create " + outdir);
+
+    int quarter = opts.threads / 4 > 0 ? opts.threads / 4 : 1;
+    PipelineStage decode, transform, encode;
+    decode.name = "decode";
+    decode.threads = opts.decode_threads > 0 ? opts.decode_threads : quarter;
+    transform.name = "transform";
+    transform.threads = opts.threads;
+    encode.name = "encode";
+    encode.threads = opts.encode_threads > 0 ? opts.encode_threads : quarter;
+
+    BoundedQueue<PipelineImage> transform_queue(transform.threads * 2), encode_queue(encode.threads * 2);
+    MemoryBudget budget((size_t)opts.memory_mb << 20);
+    std::atomic<size_t> next_file(0);
+    std::atomic<int> done(0), cached(0), failed(0);
+    std::atomic<long long> pixels(0);
+    std::vector<SDFcontext *> contexts(transform.threads, nullptr);
+    for (SDFcontext *&ctx : contexts)
+    {
+        ctx = sdfCreateContext(1, SDF_CONTEXT_HUGE_PAGES | (opts.narrow_band ? SDF_CONTEXT_NARROW_BAND : 0));
+        if (ctx == nullptr)
+        {
+            for (SDFcontext *created : contexts)
+                sdfDeleteContext(created);
+            return Error("out of memory");
+        }
+    }
+
+    auto batchStart = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    decode.running = decode.threads;
+    transform.running = transform.threads;
+    encode.running = encode.threads;
+
+    for (int t = 0; t < decode.threads; t++)
+    {
+        threads.emplace_back([&] {
+            for (size_t i; (i = next_file++) < files.size();)
+            {
+                PipelineImage image = {i, nullptr, 0, 0, 0, 0, 0};
+                if (!ImageInfo(files[i], &image.width, &image.height, &image.comp))
+                {
+                    failed++;
+                    continue;
+                }
+                // The wider formats hold the decoded bytes and the baked samples together for a while.
+                image.bytes = (size_t)image.width * image.height * image.comp;
+                if (FormatBytes(opts.format) > 1)
+                    image.bytes *= 1 + FormatBytes(opts.format);
+                budget.Acquire(image.bytes);
+                bool hit;
+                {
+                    // Hashing the pixels for the cache, and copying the output on a hit, are decode work too.
+                    StageTimer timer(&decode);
+                    {
+                        TraceScope span(opts.trace, "load", "file", TraceArg("file", files[i]));
+                        image.data = LoadImage(files[i], &image.width, &image.height, &image.comp);
+                    }
+                    hit = image.data != nullptr &&
+                          FetchBaked(cache, opts, image.data, image.width, image.height, image.comp, outputs[i], &image.key);
+                }
+                if (image.data == nullptr)
+                {
+                    budget.Release(image.bytes);
+                    failed++;
+                    continue;
+                }
+                if (hit)
+                {
+                    FreeImage(image.data);
+                    budget.Release(image.bytes);
+                    cached++;
+                    continue;
+                }
+                transform_queue.Push(image);
+            }
+            if (--decode.running == 0)
+                transform_queue.Close();
+        });
+    }
+
+    for (int t = 0; t < transform.threads; t++)
+    {
+        threads.emplace_back([&, t] {
+            PipelineImage image;
+            while (transform_queue.Pop(&image))
+            {
+                bool ok;
+                {
+                    StageTimer timer(&transform);
+                    ok = TracedBakeImage(contexts[t], opts, files[image.index], &image.data, &image.width, &image.height,
+                                         &image.comp);
+                }
+                if (!ok)
+                {
+                    Error("bake failed: " + files[image.index]);
+                    FreeImage(image.data);
+                    image.data = nullptr;
+                }
+                encode_queue.Push(image);
+            }
+            if (--transform.running == 0)
+                encode_queue.Close();
+        });
+    }
+
+    for (int t = 0; t < encode.threads; t++)
+    {
+        threads.emplace_back([&] {
+            PipelineImage image;
+            while (encode_queue.Pop(&image))
+            {
+                bool ok = false;
+                if (image.data != nullptr)
+                {
+                    StageTimer timer(&encode);
+                    TraceScope span(opts.trace, "encode", "file", TraceArg("file", outputs[image.index]));
+                    ok = WriteBaked(cache, image.key, opts, outputs[image.index], image.width, image.height, image.comp,
+                                    image.data);
+                    FreeImage(image.data);
+                }
+                budget.Release(image.bytes);
+                if (ok)
+                {
+                    done++;
+                    pixels += (long long)image.width * image.height;
+                }
+                else
+                {
+                    failed++;
+                }
+            }
+        });
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+    auto batchTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    for (SDFcontext *ctx : contexts)
+        sdfDeleteContext(ctx);
+
+    Log(opts, "Pipeline: " + std::to_string(done.load()) + " baked, " + std::to_string(cached.load()) + " cached, " +
+                  std::to_string(failed.load()) + " failed, " +
+                  std::to_string(batchTime) + " s, " + std::to_string(pixels.load() / 1e6 / batchTime) + " Mpx/s, peak " +
+                  std::to_string(budget.Peak() >> 10) + " KB decoded in flight");
+    for (PipelineStage *stage : {&decode, &transform, &encode})
+    {
+        double utilisation = stage->busy_ns.load() / 1e9 / (batchTime * stage->threads);
+        Log(opts, std::string("  ") + stage->name + ": " + std::to_string(stage->threads) + " threads, " +
+                      std::to_string((int)(utilisation * 100.0 + 0.5)) + "% busy");
+    }
+    return failed.load() == 0 ? 0 : 1;
+}
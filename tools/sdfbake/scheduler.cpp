@@ -0,0 +1,100 @@
+#include "scheduler.h"
+
+TaskPool::TaskPool(int workers)
+    : queued(0), pending(0), steals(0), next(0), quit(false)
+{
+    if (workers < 1)
+        workers = 1;
+    for (int i = 0; i < workers; i++)
+        queues.emplace_back(new Queue);
+    for (int i = 0; i < workers; i++)
+        threads.emplace_back(&TaskPool::Run, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+void TaskPool::Spawn(Task task, int worker)
+{
+    if (worker < 0)
+        worker = (int)(next.fetch_add(1) % queues.size());
+    pending++;
+    {
+        std::lock_guard<std::mutex> guard(queues[worker]->lock);
+        queues[worker]->tasks.push_back(std::move(task));
+    }
+    // Count the task before waking anyone, the sleepers check 'queued' under 'lock'.
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void TaskPool::Wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [&] { return pending.load() == 0; });
+}
+
+bool TaskPool::Pop(int worker, Task *task)
+{
+    // Own work first, newest first.
+    {
+        Queue &own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty())
+        {
+            *task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    // Then the oldest task of the others, starting from the next worker.
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        Queue &victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::Run(int worker)
+{
+    Task task;
+    for (;;)
+    {
+        if (Pop(worker, &task))
+        {
+            task(worker);
+            task = nullptr;
+            if (--pending == 0)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [&] { return quit || queued.load() > 0; });
+        if (quit)
+            return;
+    }
+}
@@ -0,0 +1,62 @@
+// Work-stealing task pool of the batch baker.
+//
+// Every worker owns a deque of tasks. A worker pushes the tasks it spawns to the back of its own deque
+// and pops from the back too, so the work of one image (load, channels, encode) stays on one worker
+// while its data is still in cache. Idle workers steal from the front of the other deques, which holds
+// the oldest and usually largest pieces of work, so a few huge images never keep the others waiting.
+
+#ifndef SDFBAKE_SCHEDULER_H
+#define SDFBAKE_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskPool
+{
+public:
+    // A task gets the index of the worker running it, in [0,Workers()).
+    typedef std::function<void(int worker)> Task;
+
+    explicit TaskPool(int workers);
+    ~TaskPool();
+
+    int Workers() const { return (int)queues.size(); }
+
+    // Queues a task. From a task, pass the running worker so that the task stays local; from
+    // outside, pass -1 and the tasks are dealt round-robin.
+    void Spawn(Task task, int worker = -1);
+
+    // Blocks until every spawned task, and every task they spawned, has run.
+    void Wait();
+
+    // Tasks taken from another worker's deque so far.
+    long long Steals() const { return steals.load(); }
+
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool Pop(int worker, Task *task);
+    void Run(int worker);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex lock; // Guards the sleeping and the completion wait.
+    std::condition_variable wake, idle;
+    std::atomic<int> queued;  // Tasks sitting in a deque.
+    std::atomic<int> pending; // Tasks spawned and not finished yet.
+    std::atomic<long long> steals;
+    std::atomic<unsigned> next;
+    bool quit;
+};
+
+#endif // SDFBAKE_SCHEDULER_H
@@ -0,0 +1,670 @@
+// sdfbake: headless distance field baker, same transform as the ImGui app without any window or device.
+//
+//   sdfbake [options] input output
+//   sdfbake [options] --batch input outdir
+//   sdfbake [options] --font font.ttf atlas
+//   sdfbake [options] --atlas input atlas
+//
+// Reads .png, .tga, .bmp, .pgm ... (anything stb_image loads) and writes .png, .tga, .bmp or .pgm,
+// keeping the number of channels of the input. --format writes 16-bit .png or .pgm, or the signed
+// distances as half or float .exr or float .pfm, see formats.cpp, or BC4 and BC5 .dds, see dds.cpp, with
+// --mips the whole mip chain. With --tile, binary .pgm files are streamed tile by
+// tile and never held in memory as a whole. With --batch, input is a directory or a list of files,
+// see batch.cpp. With --font, the glyphs of a font are baked to an atlas, see font.cpp, and
+// with --atlas, a directory or list of masks to a sprite atlas, see atlas.cpp. --trace writes a Chrome
+// trace of any of them, see trace.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#define _CRT_SECURE_NO_WARNINGS
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image_resize2.h"
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "stb_rect_pack.h"
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+#define SDF_IMPLEMENTATION // sdfbake.h includes sdf.h, the implementation comes with it.
+#include "sdfbake.h"
+#include "cache.h"
+#include "trace.h"
+
+#if defined(_WIN32)
+#define sdfbake_fseek _fseeki64
+#else
+#define sdfbake_fseek fseeko
+#endif
+
+static void PrintUsage()
+{
+    std::cout << "usage: sdfbake [options] input output\n"
+                 "       sdfbake [options] --batch input outdir\n"
+                 "       sdfbake [options] --font font.ttf atlas\n"
+                 "       sdfbake [options] --atlas input atlas\n"
+                 "  -r, --radius N         search radius in pixels, inside and outside (default 64)\n"
+                 "      --outside N        outside radius in pixels\n"
+                 "      --inside N         inside radius in pixels\n"
+                 "  -c, --channels rgba    channels to bake, any of r, g, b, a (default a)\n"
+                 "  -e, --engine NAME      8ssedt, adaptive, exact or coverage (default 8ssedt); radii up to 0.5\n"
+                 "                         always bake with coverage, within a few steps of the others\n"
+                 "  -j, --threads N        worker threads, the main one included (default all cores)\n"
+                 "      --no-narrow-band   transform the whole image, not only the pixels near a contour\n"
+                 "  -s, --supersample N    the input is N times the output size: bake at full size, downsample the\n"
+                 "                         distances, then quantise (radii in output pixels, not with --tile)\n"
+                 "  -f, --format NAME      output samples: u8, u16 (.png, .pgm), half (.exr) or float (.exr, .pfm),\n"
+                 "                         the last two hold the signed distance in pixels, or bc (.dds) for BC4\n"
+                 "                         or BC5 blocks of one or two channels (default u8)\n"
+                 "      --mips             write the full mip chain to a .dds file, each level resized from the\n"
+                 "                         float distances of the level above (u8 or bc, not with --tile)\n"
+                 "      --tile N           stream binary .pgm input and output in N x N tiles (-e exact only)\n"
+                 "      --batch            bake every image of the input directory, or listed one per line in the\n"
+                 "                         input text file, to outdir; -j sets the number of images baked at once\n"
+                 "      --pipeline         with --batch, run decode, transform (-j threads) and encode as separate\n"
+                 "                         stages connected by bounded queues\n"
+                 "      --decode-threads N pipeline decode threads (default a quarter of -j)\n"
+                 "      --encode-threads N pipeline encode threads (default a quarter of -j)\n"
+                 "      --memory MB        pipeline ceiling for the decoded images in flight (default 1024)\n"
+                 "      --font             bake the glyphs of a .ttf or .otf font to an atlas image, and their\n"
+                 "                         metrics to the atlas path as .glyphs\n"
+                 "      --font-size N      glyph pixel height (default 48)\n"
+                 "      --chars LIST       code points and ranges, e.g. 32-126,0x4e00-0x9fff, or all (default\n"
+                 "                         32-126)\n"
+                 "      --atlas            bake the masks of the input directory or list, padded by the radius, to\n"
+                 "                         sprite atlas pages, and their UVs to the atlas path as .json\n"
+                 "      --atlas-size N     atlas page size (default 4096)\n"
+                 "      --cache DIR        skip the inputs baked before with the same pixels and options, keeping\n"
+                 "                         the outputs in DIR (not with --tile)\n"
+                 "      --cache-size MB    cache size, the least recently used outputs go first (default 4096)\n"
+                 "      --trace FILE       write a Chrome trace (trace_event JSON) of the files, channels and\n"
+                 "                         transform phases to FILE, for chrome://tracing or Perfetto\n"
+                 "  -q, --quiet            print errors only\n";
+}
+
+// Grey images have their grey in r, g and b, and their alpha in a.
+int ChannelsForComp(int channels, int comp)
+{
+    switch (comp)
+    {
+    case 1:
+        return channels != 0 ? 1 : 0;
+    case 2:
+        return ((channels & 7) != 0 ? 1 : 0) | ((channels & 8) != 0 ? 2 : 0);
+    case 3:
+        return channels & 7;
+    default:
+        return channels & 15;
+    }
+}
+
+std::string ChannelNames(int channels)
+{
+    std::string names;
+    for (int c = 0; c < 4; c++)
+    {
+        if (channels & (1 << c))
+            names += "rgba"[c];
+    }
+    return names;
+}
+
+void AppendU32(std::vector<unsigned char> *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        bytes->push_back((unsigned char)(value >> (8 * i)));
+}
+
+std::string JsonQuote(std::string const &value)
+{
+    std::string quoted = "\"";
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        if ((unsigned char)c >= 0x20)
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+bool ImageInfo(std::string const &path, int *width, int *height, int *comp)
+{
+    if (stbi_info(path.c_str(), width, height, comp))
+        return true;
+    Error("cannot load " + path + ": " + stbi_failure_reason());
+    return false;
+}
+
+unsigned char *LoadImage(std::string const &path, int *width, int *height, int *comp)
+{
+    unsigned char *data = stbi_load(path.c_str(), width, height, comp, 0);
+    if (data == nullptr)
+        Error("cannot load " + path + ": " + stbi_failure_reason());
+    return data;
+}
+
+void FreeImage(unsigned char *data)
+{
+    stbi_image_free(data);
+}
+
+bool CanWriteImage(std::string const &path, int format)
+{
+    std::string lower = to_lower(path);
+    switch (format)
+    {
+    case SDF_FORMAT_UNORM8:
+        return ends_with(lower, ".png") || ends_with(lower, ".tga") || ends_with(lower, ".bmp") || ends_with(lower, ".pgm") ||
+               ends_with(lower, ".dds");
+    case SDF_FORMAT_UNORM16:
+        return ends_with(lower, ".png") || ends_with(lower, ".pgm");
+    case SDF_FORMAT_HALF:
+        return ends_with(lower, ".exr");
+    case SDFBAKE_FORMAT_BC:
+        return ends_with(lower, ".dds");
+    default:
+        return ends_with(lower, ".exr") || ends_with(lower, ".pfm");
+    }
+}
+
+static void AppendBytes(void *context, void *data, int size)
+{
+    std::vector<unsigned char> *bytes = (std::vector<unsigned char> *)context;
+    bytes->insert(bytes->end(), (unsigned char *)data, (unsigned char *)data + size);
+}
+
+bool EncodeImage(std::string const &path, int width, int height, int comp, int format, int levels, const void *data,
+                 std::vector<unsigned char> *bytes)
+{
+    std::string lower = to_lower(path);
+    if ((format == SDFBAKE_FORMAT_BC || format == SDF_FORMAT_UNORM8) && ends_with(lower, ".dds"))
+        return EncodeDds(width, height, comp, format, levels, data, bytes);
+    if (levels > 1)
+    {
+        Error("cannot write " + path + ": mip levels need .dds");
+        return false;
+    }
+    if (format != SDF_FORMAT_UNORM8)
+        return EncodeWide(path, width, height, comp, format, data, bytes);
+    bytes->clear();
+    if (ends_with(lower, ".png"))
+        return stbi_write_png_to_func(AppendBytes, bytes, width, height, comp, data, width * comp) != 0;
+    if (ends_with(lower, ".tga"))
+        return stbi_write_tga_to_func(AppendBytes, bytes, width, height, comp, data) != 0;
+    if (ends_with(lower, ".bmp"))
+        return stbi_write_bmp_to_func(AppendBytes, bytes, width, height, comp, data) != 0;
+    if (ends_with(lower, ".pgm") && comp == 1)
+    {
+        char header[64];
+        int n = snprintf(header, sizeof(header), "P5\n%d %d\n255\n", width, height);
+        bytes->assign(header, header + n);
+        bytes->insert(bytes->end(), (const unsigned char *)data, (const unsigned char *)data + (size_t)width * height);
+        return true;
+    }
+    Error("cannot write " + path + ": unsupported format");
+    return false;
+}
+
+bool WriteBytes(std::string const &path, const void *data, size_t size)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        Error("cannot create " + path);
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, fp) == size;
+    if (fclose(fp) != 0 || !ok)
+    {
+        Error("cannot write " + path);
+        return false;
+    }
+    return true;
+}
+
+bool WriteImage(std::string const &path, int width, int height, int comp, int format, int levels, const void *data)
+{
+    std::vector<unsigned char> bytes;
+    return EncodeImage(path, width, height, comp, format, levels, data, &bytes) &&
+           WriteBytes(path, bytes.data(), bytes.size());
+}
+
+bool BuildChannels(SDFcontext *ctx, BakeOptions const &opts, unsigned char *out, int outstride, int outpixstride,
+                   const unsigned char *img, int width, int height, int stride, int pixstride, int channels)
+{
+    if (opts.engine == SDFBAKE_ENGINE_COVERAGE ||
+        (opts.outside_radius <= SDF_COVERAGE_RADIUS && opts.inside_radius <= SDF_COVERAGE_RADIUS))
+    {
+        return sdfContextCoverageToDistanceField(ctx, out, outstride, outpixstride, opts.outside_radius, opts.inside_radius,
+                                                 img, width, height, stride, pixstride, channels) != 0;
+    }
+    return sdfContextBuildChannels(ctx, out, outstride, outpixstride, opts.outside_radius, opts.inside_radius, img, width,
+                                   height, stride, pixstride, channels, opts.engine) != 0;
+}
+
+bool BakeImage(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int *comp)
+{
+    if (opts.mips)
+        return BakeMips(ctx, opts, data, width, height, comp);
+    if (opts.format == SDFBAKE_FORMAT_BC)
+        return BakeBlocks(ctx, opts, data, width, height, comp);
+    if (opts.supersample > 1)
+        return BakeSupersampled(ctx, opts, data, width, height, *comp);
+    int channels = ChannelsForComp(opts.channels, *comp), stride = *width * *comp;
+    if (opts.format == SDF_FORMAT_UNORM8)
+    {
+        return BuildChannels(ctx, opts, *data, stride, *comp, *data, *width, *height, stride, *comp, channels);
+    }
+    unsigned char *wide = WidenImage(*data, *width, *height, *comp, channels, opts.format);
+    if (wide == nullptr || !sdfContextBuildFormat(ctx, wide, stride, *comp, opts.format, opts.outside_radius,
+                                                  opts.inside_radius, *data, *width, *height, stride, *comp, channels,
+                                                  opts.engine))
+    {
+        FreeImage(wide);
+        return false;
+    }
+    FreeImage(*data);
+    *data = wide;
+    return true;
+}
+
+bool TracedBakeImage(SDFcontext *ctx, BakeOptions const &opts, std::string const &input, unsigned char **data, int *width,
+                     int *height, int *comp)
+{
+    std::string args = TraceArg("file", input) + ", " + TraceArg("channels", ChannelNames(opts.channels));
+    TraceScope span(opts.trace, "bake", "file", args);
+    TraceBuilds builds(opts.trace, ctx, args);
+    return BakeImage(ctx, opts, data, width, height, comp);
+}
+
+// Binary 8-bit PGM file streamed a rectangle at a time.
+struct PgmStream
+{
+    FILE *fp = nullptr;
+    int width = 0, height = 0;
+    long long offset = 0; // Start of the pixels.
+};
+
+static int PgmSkipSpace(FILE *fp)
+{
+    int c = fgetc(fp);
+    for (;;)
+    {
+        if (c == '#')
+        {
+            while (c != '\n' && c != EOF)
+                c = fgetc(fp);
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            c = fgetc(fp);
+        else
+            return c;
+    }
+}
+
+static bool PgmOpen(PgmStream *pgm, std::string const &path)
+{
+    int maxval = 0, c;
+    pgm->fp = fopen(path.c_str(), "rb");
+    if (pgm->fp == nullptr)
+        return false;
+    if (fgetc(pgm->fp) != 'P' || fgetc(pgm->fp) != '5')
+        return false;
+    int *fields[3] = {&pgm->width, &pgm->height, &maxval};
+    for (int i = 0; i < 3; i++)
+    {
+        c = PgmSkipSpace(pgm->fp);
+        *fields[i] = 0;
+        while (c >= '0' && c <= '9')
+        {
+            *fields[i] = *fields[i] * 10 + (c - '0');
+            c = fgetc(pgm->fp);
+        }
+    }
+    // A single whitespace byte separates the header from the pixels.
+    pgm->offset = ftell(pgm->fp);
+    return pgm->width > 0 && pgm->height > 0 && maxval == 255;
+}
+
+static bool PgmCreate(PgmStream *pgm, std::string const &path, int width, int height)
+{
+    pgm->fp = fopen(path.c_str(), "wb");
+    if (pgm->fp == nullptr)
+        return false;
+    pgm->width = width;
+    pgm->height = height;
+    fprintf(pgm->fp, "P5\n%d %d\n255\n", width, height);
+    pgm->offset = ftell(pgm->fp);
+    return true;
+}
+
+// Input and output of a streamed bake.
+struct PgmTiles
+{
+    PgmStream in, out;
+};
+
+static int PgmReadTile(void *user, unsigned char *pixels, int stride, int x0, int y0, int x1, int y1)
+{
+    PgmStream *pgm = &((PgmTiles *)user)->in;
+    for (int y = y0; y < y1; y++)
+    {
+        if (sdfbake_fseek(pgm->fp, pgm->offset + (long long)y * pgm->width + x0, SEEK_SET) != 0 ||
+            fread(pixels + (size_t)(y - y0) * stride, 1, x1 - x0, pgm->fp) != (size_t)(x1 - x0))
+            return 0;
+    }
+    return 1;
+}
+
+static int PgmWriteTile(void *user, unsigned char *pixels, int stride, int x0, int y0, int x1, int y1)
+{
+    PgmStream *pgm = &((PgmTiles *)user)->out;
+    for (int y = y0; y < y1; y++)
+    {
+        if (sdfbake_fseek(pgm->fp, pgm->offset + (long long)y * pgm->width + x0, SEEK_SET) != 0 ||
+            fwrite(pixels + (size_t)(y - y0) * stride, 1, x1 - x0, pgm->fp) != (size_t)(x1 - x0))
+            return 0;
+    }
+    return 1;
+}
+
+static bool BakeTiled(SDFcontext *ctx, std::string const &input, std::string const &output, BakeOptions const &opts)
+{
+    PgmTiles files;
+    PgmStream &in = files.in, &out = files.out;
+    bool ok = false;
+    if (!ends_with(to_lower(input), ".pgm") || !ends_with(to_lower(output), ".pgm"))
+        Error("--tile needs binary .pgm input and output");
+    else if (!PgmOpen(&in, input))
+        Error("cannot read " + input + " as an 8-bit binary PGM");
+    else if (!PgmCreate(&out, output, in.width, in.height))
+        Error("cannot create " + output);
+    else
+    {
+        // The tiles are many builds, the bake span gets the totals of their phases.
+        TraceScope span(opts.trace, "bake", "file", TraceArg("file", input));
+        TraceBuilds builds(opts.trace, ctx);
+        ok = sdfContextBuildTiled(ctx, PgmReadTile, PgmWriteTile, &files, in.width, in.height, 1, 1,
+                                  opts.outside_radius, opts.inside_radius, opts.tile) != 0;
+        span.AddArgs(PhaseArgs(builds.Stats()));
+        if (!ok)
+            Error("bake failed: " + input);
+    }
+    if (in.fp != nullptr)
+        fclose(in.fp);
+    if (out.fp != nullptr && fclose(out.fp) != 0)
+        ok = false;
+    return ok;
+}
+
+static bool Bake(SDFcontext *ctx, BakeCache *cache, std::string const &input, std::string const &output,
+                 BakeOptions const &opts)
+{
+    int width, height, comp;
+    uint64_t key;
+    unsigned char *data;
+    {
+        TraceScope span(opts.trace, "load", "file", TraceArg("file", input));
+        data = LoadImage(input, &width, &height, &comp);
+    }
+    if (data == nullptr)
+        return false;
+    if (FetchBaked(cache, opts, data, width, height, comp, output, &key))
+    {
+        FreeImage(data);
+        return true;
+    }
+    bool ok = TracedBakeImage(ctx, opts, input, &data, &width, &height, &comp);
+    if (!ok)
+        Error("bake failed: " + input);
+    else
+    {
+        TraceScope span(opts.trace, "encode", "file", TraceArg("file", output));
+        ok = WriteBaked(cache, key, opts, output, width, height, comp, data);
+    }
+    FreeImage(data);
+    return ok;
+}
+
+static bool ParseRadius(const char *text, float *radius)
+{
+    char *end;
+    float value = strtof(text, &end);
+    if (*end != '\0' || !(value > 0.0f))
+        return false;
+    *radius = value;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    BakeOptions opts;
+    std::string paths[2], trace_path;
+    int npaths = 0;
+    bool batch = false, pipeline = false, font = false, atlas = false, engine_set = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if ((arg == "-r" || arg == "--radius") && has_value)
+        {
+            if (!ParseRadius(argv[++i], &opts.outside_radius))
+                return Error("bad radius: " + std::string(argv[i]));
+            opts.inside_radius = opts.outside_radius;
+        }
+        else if (arg == "--outside" && has_value)
+        {
+            if (!ParseRadius(argv[++i], &opts.outside_radius))
+                return Error("bad radius: " + std::string(argv[i]));
+        }
+        else if (arg == "--inside" && has_value)
+        {
+            if (!ParseRadius(argv[++i], &opts.inside_radius))
+                return Error("bad radius: " + std::string(argv[i]));
+        }
+        else if ((arg == "-c" || arg == "--channels") && has_value)
+        {
+            std::string value = to_lower(argv[++i]);
+            opts.channels = 0;
+            for (char c : value)
+            {
+                const char *p = strchr("rgba", c);
+                if (p == nullptr)
+                    return Error("bad channels: " + value);
+                opts.channels |= 1 << (p - "rgba");
+            }
+        }
+        else if ((arg == "-e" || arg == "--engine") && has_value)
+        {
+            std::string value = to_lower(argv[++i]);
+            engine_set = true;
+            if (value == "8ssedt")
+                opts.engine = SDF_ENGINE_8SSEDT;
+            else if (value == "adaptive")
+                opts.engine = SDF_ENGINE_8SSEDT_ADAPTIVE;
+            else if (value == "exact")
+                opts.engine = SDF_ENGINE_EXACT;
+            else if (value == "coverage")
+                opts.engine = SDFBAKE_ENGINE_COVERAGE;
+            else
+                return Error("unknown engine: " + value);
+        }
+        else if ((arg == "-j" || arg == "--threads") && has_value)
+        {
+            opts.threads = atoi(argv[++i]);
+            if (opts.threads < 1)
+                return Error("bad thread count: " + std::string(argv[i]));
+        }
+        else if (arg == "--no-narrow-band")
+            opts.narrow_band = false;
+        else if ((arg == "-s" || arg == "--supersample") && has_value)
+        {
+            opts.supersample = atoi(argv[++i]);
+            if (opts.supersample < 1)
+                return Error("bad supersample factor: " + std::string(argv[i]));
+        }
+        else if ((arg == "-f" || arg == "--format") && has_value)
+        {
+            std::string value = to_lower(argv[++i]);
+            if (value == "u8")
+                opts.format = SDF_FORMAT_UNORM8;
+            else if (value == "u16")
+                opts.format = SDF_FORMAT_UNORM16;
+            else if (value == "half")
+                opts.format = SDF_FORMAT_HALF;
+            else if (value == "float")
+                opts.format = SDF_FORMAT_FLOAT;
+            else if (value == "bc")
+                opts.format = SDFBAKE_FORMAT_BC;
+            else
+                return Error("unknown format: " + value);
+        }
+        else if (arg == "--mips")
+            opts.mips = true;
+        else if (arg == "--tile" && has_value)
+        {
+            opts.tile = atoi(argv[++i]);
+            if (opts.tile < 1)
+                return Error("bad tile size: " + std::string(argv[i]));
+        }
+        else if (arg == "--batch")
+            batch = true;
+        else if (arg == "--pipeline")
+            pipeline = true;
+        else if (arg == "--font")
+            font = true;
+        else if (arg == "--atlas")
+            atlas = true;
+        else if (arg == "--atlas-size" && has_value)
+        {
+            opts.atlas_size = atoi(argv[++i]);
+            if (opts.atlas_size < 4)
+                return Error("bad atlas size: " + std::string(argv[i]));
+        }
+        else if (arg == "--font-size" && has_value)
+        {
+            opts.font_size = atoi(argv[++i]);
+            if (opts.font_size < 1)
+                return Error("bad font size: " + std::string(argv[i]));
+        }
+        else if (arg == "--chars" && has_value)
+            opts.font_chars = argv[++i];
+        else if (arg == "--cache" && has_value)
+            opts.cache_dir = argv[++i];
+        else if (arg == "--trace" && has_value)
+            trace_path = argv[++i];
+        else if ((arg == "--decode-threads" || arg == "--encode-threads" || arg == "--memory" || arg == "--cache-size") &&
+                 has_value)
+        {
+            int value = atoi(argv[++i]);
+            if (value < 1)
+                return Error("bad " + arg.substr(2) + ": " + std::string(argv[i]));
+            if (arg == "--memory")
+                opts.memory_mb = value;
+            else if (arg == "--cache-size")
+                opts.cache_mb = value;
+            else if (arg == "--decode-threads")
+                opts.decode_threads = value;
+            else
+                opts.encode_threads = value;
+        }
+        else if (arg == "-q" || arg == "--quiet")
+            opts.quiet = true;
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            PrintUsage();
+            return Error("unknown option: " + arg);
+        }
+        else if (npaths < 2)
+            paths[npaths++] = arg;
+        else
+        {
+            PrintUsage();
+            return Error("too many arguments");
+        }
+    }
+    if (npaths != 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (pipeline && !batch)
+        return Error("--pipeline needs --batch");
+    BakeTrace trace;
+    if (!trace_path.empty())
+        opts.trace = &trace;
+    // Writes the trace, if any, once the run is over.
+    auto finish = [&](int code) {
+        if (opts.trace != nullptr && !trace.Write(trace_path))
+            return 1;
+        return code;
+    };
+    if (font || atlas)
+    {
+        std::string mode = font ? "--font" : "--atlas";
+        if (font && atlas)
+            return Error("--font and --atlas do not go together");
+        if (batch || opts.tile > 0 || opts.supersample > 1 || opts.mips || opts.format != SDF_FORMAT_UNORM8)
+            return Error(mode + " does not apply to --batch, --tile, --supersample, --mips or --format");
+        if (!CanWriteImage(paths[1], opts.format))
+            return Error("cannot write " + paths[1] + ": unsupported format");
+        return finish(font ? RunFont(opts, paths[0], paths[1]) : RunAtlas(opts, paths[0], paths[1]));
+    }
+    if (opts.engine == SDFBAKE_ENGINE_COVERAGE &&
+        (opts.tile > 0 || opts.supersample > 1 || opts.mips || (opts.format != SDF_FORMAT_UNORM8 && opts.format != SDFBAKE_FORMAT_BC)))
+        return Error("-e coverage only bakes bytes, not --tile, --supersample, --mips or --format u16, half or float");
+    if (opts.tile > 0 && engine_set && opts.engine != SDF_ENGINE_EXACT)
+        return Error("--tile only bakes with -e exact");
+    if (opts.tile > 0 && opts.supersample > 1)
+        return Error("--supersample does not apply to --tile");
+    if (opts.tile > 0 && opts.format != SDF_FORMAT_UNORM8)
+        return Error("--format does not apply to --tile");
+    if (opts.mips && opts.format != SDF_FORMAT_UNORM8 && opts.format != SDFBAKE_FORMAT_BC)
+        return Error("--mips needs --format u8 or bc");
+    if (opts.tile > 0 && opts.mips)
+        return Error("--mips does not apply to --tile");
+    if (!batch && (!CanWriteImage(paths[1], opts.format) || (opts.mips && !ends_with(to_lower(paths[1]), ".dds"))))
+        return Error("cannot write " + paths[1] + ": unsupported format");
+    BakeCache cache;
+    if (!opts.cache_dir.empty() && !cache.Open(opts.cache_dir, (size_t)opts.cache_mb << 20))
+        return Error("cannot open cache " + opts.cache_dir);
+    if (batch)
+    {
+        if (opts.tile > 0)
+            return Error("--tile does not apply to --batch");
+        int code = pipeline ? RunPipeline(opts, &cache, paths[0], paths[1]) : RunBatch(opts, &cache, paths[0], paths[1]);
+        if (cache.IsOpen())
+            Log(opts, CacheReport(&cache));
+        return finish(code);
+    }
+
+    auto bakeStart = std::chrono::steady_clock::now();
+    SDFcontext *ctx = sdfCreateContext(opts.threads, SDF_CONTEXT_HUGE_PAGES | (opts.narrow_band ? SDF_CONTEXT_NARROW_BAND : 0));
+    if (ctx == nullptr)
+        return Error("out of memory");
+    bool ok = opts.tile > 0 ? BakeTiled(ctx, paths[0], paths[1], opts) : Bake(ctx, &cache, paths[0], paths[1], opts);
+    auto bakeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+    if (ok)
+    {
+        Log(opts, "Bake " + paths[0] + " -> " + paths[1] + ": " + std::to_string(bakeTime) + " ms, scratch peak " +
+                      std::to_string(sdfContextPeakScratch(ctx) >> 10) + " KB");
+        if (cache.IsOpen())
+            Log(opts, CacheReport(&cache));
+    }
+    sdfDeleteContext(ctx);
+    return finish(ok ? 0 : 1);
+}
@@ -0,0 +1,169 @@
+// Shared state of the sdfbake command line baker. The stb and sdf implementations live in sdfbake.cpp,
+// the other files only see the declarations.
+
+#ifndef SDFBAKE_H
+#define SDFBAKE_H
+
+#include <stdint.h>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "sdf.h"
+
+class BakeCache;
+class BakeTrace;
+
+// Output format of BC4 or BC5 .dds files next to the SDFformat ones, see dds.cpp.
+#define SDFBAKE_FORMAT_BC 16
+
+// Engine of -e coverage next to the SDFengine ones: the per pixel estimate of
+// sdfContextCoverageToDistanceField(), for outlines that need no field a pixel away from the contour.
+#define SDFBAKE_ENGINE_COVERAGE 16
+
+struct BakeOptions
+{
+    float outside_radius = 64.0f;
+    float inside_radius = 64.0f;
+    int channels = 1 << 3; // Bit i bakes the byte at offset i of an RGBA pixel.
+    int engine = SDF_ENGINE_8SSEDT;
+    int threads = std::thread::hardware_concurrency() > 0 ? (int)std::thread::hardware_concurrency() : 1;
+    bool narrow_band = true;
+    int tile = 0; // Tile size of streamed builds, 0 bakes the whole image at once.
+    int supersample = 1; // Input pixels per output pixel along each axis, see supersample.cpp.
+    int format = SDF_FORMAT_UNORM8; // Output samples, see SDFformat, or SDFBAKE_FORMAT_BC.
+    bool mips = false; // Full mip chain in a .dds file, see BakeMips().
+    int decode_threads = 0; // Pipelined batch stage threads, 0 picks a quarter of 'threads'.
+    int encode_threads = 0;
+    int memory_mb = 1024; // Pipelined batch ceiling for the decoded images in flight.
+    int font_size = 48; // Font atlas glyph pixel height, see font.cpp.
+    std::string font_chars = "32-126";
+    int atlas_size = 4096; // Sprite atlas page size, see atlas.cpp.
+    std::string cache_dir; // Bake cache directory, empty for none.
+    int cache_mb = 4096;
+    BakeTrace *trace = nullptr; // Chrome trace of the run, see trace.h, null for none.
+    bool quiet = false;
+};
+
+inline bool ends_with(std::string const &value, std::string const &ending)
+{
+    if (ending.size() > value.size())
+        return false;
+    return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+}
+
+inline std::string to_lower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+    return value;
+}
+
+inline void Log(BakeOptions const &opts, std::string const &value)
+{
+    if (!opts.quiet)
+        std::cout << value << std::endl;
+}
+
+// Prints the error and returns the exit code of a failed run.
+inline int Error(std::string const &value)
+{
+    std::cerr << "sdfbake: " << value << std::endl;
+    return 1;
+}
+
+// Maps the rgba channel selection to the bytes of a pixel with 'comp' components.
+int ChannelsForComp(int channels, int comp);
+// The letters of the rgba channel selection, e.g. "ra".
+std::string ChannelNames(int channels);
+// Appends 'value' as 4 little endian bytes, as the DDS, EXR and glyph metrics headers store it.
+void AppendU32(std::vector<unsigned char> *bytes, uint32_t value);
+// 'value' as a JSON string literal, quotes and backslashes escaped and control characters dropped.
+std::string JsonQuote(std::string const &value);
+
+// Image files, through stb_image and stb_image_write. LoadImage() keeps the components of the file,
+// the pixels are released with FreeImage(). ImageInfo() only reads the header.
+bool ImageInfo(std::string const &path, int *width, int *height, int *comp);
+unsigned char *LoadImage(std::string const &path, int *width, int *height, int *comp);
+void FreeImage(unsigned char *data);
+// The written images hold 'comp' samples of 'format' per pixel. Only .dds files take 'levels' above 1,
+// the mip chain of MipChainSize() bytes.
+bool CanWriteImage(std::string const &path, int format);
+bool WriteImage(std::string const &path, int width, int height, int comp, int format, int levels, const void *data);
+// The contents WriteImage() would write, in the file format of the extension of 'path'.
+bool EncodeImage(std::string const &path, int width, int height, int comp, int format, int levels, const void *data,
+                 std::vector<unsigned char> *bytes);
+bool WriteBytes(std::string const &path, const void *data, size_t size);
+
+// Samples wider than a byte, in formats.cpp. StoreSample() writes sample 'i' of 'format' from its 0..1
+// encoding 'value' or, for the half and float formats, from 'distance'. WidenImage() allocates the
+// samples of an image and converts the channels that are not in 'channels' from 'data'; FreeImage()
+// releases it. EncodeWide() is EncodeImage() for 16-bit .png and .pgm, .exr and .pfm.
+int FormatBytes(int format);
+void StoreSample(void *data, size_t i, int format, float value, float distance);
+unsigned char *WidenImage(const unsigned char *data, int width, int height, int comp, int channels, int format);
+bool EncodeWide(std::string const &path, int width, int height, int comp, int format, const void *data,
+                std::vector<unsigned char> *bytes);
+
+// sdfContextBuildChannels() with the radii and engine of 'opts'. Runs the coverage estimate instead for
+// SDFBAKE_ENGINE_COVERAGE, and for every engine when both radii are at most SDF_COVERAGE_RADIUS, where
+// the builds give the same bytes but for a few steps.
+bool BuildChannels(SDFcontext *ctx, BakeOptions const &opts, unsigned char *out, int outstride, int outpixstride,
+                   const unsigned char *img, int width, int height, int stride, int pixstride, int channels);
+
+// Bakes the selected channels of the '*comp' component '*data' in opts.format. Bytes are baked in place,
+// the other formats replace '*data' with their samples, and supersampled bakes also the size. Block
+// compressed bakes replace '*data' with the blocks and '*comp' with the compressed channels.
+bool BakeImage(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int *comp);
+
+// BakeImage() as a bake span of 'input' in opts.trace, with the phases of the transform.
+bool TracedBakeImage(SDFcontext *ctx, BakeOptions const &opts, std::string const &input, unsigned char **data, int *width,
+                     int *height, int *comp);
+
+// Bakes the 'comp' component '*data' at 1/opts.supersample of its size with the ctx threads, replacing
+// the pixels and the size. Returns false if the context or the resize ran out of memory.
+bool BakeSupersampled(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int comp);
+
+// Mip chains, in supersample.cpp. MipLevels() is the number of levels down to 1x1 with opts.mips, else 1.
+// MipChainSize() is the bytes of the first 'levels' levels, each level following the one above it.
+// BakeMips() is BakeImage() with opts.mips, for the bytes and SDFBAKE_FORMAT_BC; the size becomes the
+// size of level 0. The levels whose pixels are larger than the radius come out closer to coverage than
+// to distance, the field is not baked far enough past the radius for them.
+int MipLevels(BakeOptions const &opts, int width, int height);
+size_t MipChainSize(int width, int height, int comp, int format, int levels);
+bool BakeMips(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int *comp);
+
+// Block compression, in dds.cpp. BakeBlocks() is BakeImage() for SDFBAKE_FORMAT_BC: one or two selected
+// channels, compressed as BC4 or BC5 while the build remaps them. CompressBlocks() compresses the blocks
+// of rows [y0,y1) of the 'channels' of 'data' to 'blocks', BlocksSize() bytes for 'comp' channels.
+// EncodeDds() is EncodeImage() for .dds files, of blocks or bytes.
+size_t BlocksSize(int width, int height, int comp);
+void CompressBlocks(const unsigned char *data, int width, int height, int comp, int channels, unsigned char *blocks,
+                    int y0, int y1);
+bool BakeBlocks(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int *comp);
+bool EncodeDds(int width, int height, int comp, int format, int levels, const void *data, std::vector<unsigned char> *bytes);
+
+// Lists the images of 'input', a directory or a text file listing one image path per line.
+bool ListInputs(std::string const &input, std::vector<std::string> *files);
+// Same file name in 'outdir', as .png (.exr for half and float, .dds for bc and mips) when the input
+// format cannot be written.
+std::string OutputPath(std::string const &outdir, std::string const &input, BakeOptions const &opts);
+bool CreateOutputDir(std::string const &outdir);
+
+// Bakes every image of 'input' into 'outdir' under the same file names. Returns the process exit code.
+// RunBatch() schedules the load, channel and encode tasks of all images on one work-stealing pool,
+// RunPipeline() gives decode, transform and encode their own threads connected by bounded queues.
+// Both skip the images found in 'cache', which may be NULL, and add the others to it.
+int RunBatch(BakeOptions const &opts, BakeCache *cache, std::string const &input, std::string const &outdir);
+int RunPipeline(BakeOptions const &opts, BakeCache *cache, std::string const &input, std::string const &outdir);
+
+// Bakes the opts.font_chars glyphs of the .ttf or .otf 'input' to the 'output' atlas image, and their
+// metrics to the same path as .glyphs. Returns the process exit code.
+int RunFont(BakeOptions const &opts, std::string const &input, std::string const &output);
+
+// Bakes the masks of 'input', listed as for RunBatch(), to the 'output' sprite atlas, and their UVs to
+// the same path as .json. Pages after the first get _1, _2 ... file names. Returns the process exit code.
+int RunAtlas(BakeOptions const &opts, std::string const &input, std::string const &output);
+
+#endif // SDFBAKE_H
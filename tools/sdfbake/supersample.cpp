@@ -0,0 +1,248 @@
+// Supersampled bakes. The input is a mask at N times the output size: it is baked to a float distance
+// field at full size, downsampled with the stb_image_resize2 Mitchell filter, and only then converted to
+// the output format, so the full size field never goes through bytes. The small texture gets the contour
+// precision of the large mask for the cost of one transform and one resize.
+//
+// Mip chains come from the same float field: every level is resized from the float level above it and
+// quantised on its own, rather than box filtering the clamped bytes of the level above, which pulls the
+// contours towards the saturated side.
+//
+// No resize shrinks by more than 2x: large factors and the small levels are reached by halving the field
+// in steps, which keeps the Mitchell filter at a few taps per pixel instead of spanning the whole factor.
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "sdfbake.h"
+#include "stb_image_resize2.h"
+
+// Output pixels the downsampling filter reaches on each side, 2 for the last halving step, 1 for the one
+// before it and so on. The float field is baked that much past the radius so that the clamp does not leak
+// into the filtered values.
+#define SUPERSAMPLE_FILTER_REACH 4.0f
+
+static stbir_pixel_layout LayoutForComp(int comp)
+{
+    switch (comp)
+    {
+    case 1:
+        return STBIR_1CHANNEL;
+    case 2:
+        return STBIR_2CHANNEL;
+    case 3:
+        return STBIR_RGB;
+    default:
+        return STBIR_4CHANNEL;
+    }
+}
+
+// The slices of one resize and whether each of them succeeded.
+struct ResizeSplits
+{
+    STBIR_RESIZE *resize;
+    std::vector<int> done;
+};
+
+static void ResizeSplit(void *user, int index, int)
+{
+    ResizeSplits *splits = (ResizeSplits *)user;
+    splits->done[index] = stbir_resize_extended_split(splits->resize, index, 1);
+}
+
+// Resizes the 'comp' component 'field' to 'small' with the Mitchell filter, split over the context threads.
+static bool ResizeField(SDFcontext *ctx, const float *field, int w, int h, float *small, int ow, int oh, int comp)
+{
+    STBIR_RESIZE resize;
+    stbir_resize_init(&resize, field, w, h, w * comp * (int)sizeof(float), small, ow, oh, ow * comp * (int)sizeof(float),
+                      LayoutForComp(comp), STBIR_TYPE_FLOAT);
+    stbir_set_filters(&resize, STBIR_FILTER_MITCHELL, STBIR_FILTER_MITCHELL);
+    int count = stbir_build_samplers_with_splits(&resize, sdfContextThreads(ctx));
+    if (count == 0)
+        return false;
+    ResizeSplits splits = {&resize, std::vector<int>(count, 0)};
+    sdfContextRun(ctx, count, ResizeSplit, &splits);
+    stbir_free_samplers(&resize);
+    return std::find(splits.done.begin(), splits.done.end(), 0) == splits.done.end();
+}
+
+// ResizeField() to 'ow' x 'oh' in steps of at most 2x along each axis.
+static bool DownsampleField(SDFcontext *ctx, const float *field, int w, int h, float *small, int ow, int oh, int comp)
+{
+    std::vector<float> steps[2];
+    int i = 0;
+    while (w > 2 * ow || h > 2 * oh)
+    {
+        int sw = std::max((w + 1) / 2, ow), sh = std::max((h + 1) / 2, oh);
+        steps[i].resize((size_t)sw * sh * comp);
+        if (!ResizeField(ctx, field, w, h, steps[i].data(), sw, sh, comp))
+            return false;
+        field = steps[i].data();
+        w = sw;
+        h = sh;
+        i ^= 1;
+    }
+    return ResizeField(ctx, field, w, h, small, ow, oh, comp);
+}
+
+// Same mapping as the builds, with the distances of 'small' back in output pixels, 'factor' input pixels
+// each, and clamped to the radii. The unselected channels hold 0..1.
+static void StoreField(BakeOptions const &opts, int format, const float *small, size_t count, int comp, int channels,
+                       int factor, void *out)
+{
+    float scale = 1.0f / factor;
+    for (size_t i = 0; i < count; i++)
+    {
+        float value = small[i];
+        if (channels & (1 << (i % comp)))
+        {
+            float d = value * scale;
+            d = d > opts.inside_radius ? opts.inside_radius : d < -opts.outside_radius ? -opts.outside_radius : d;
+            StoreSample(out, i, format, 0.5f + 0.5f * d / (d > 0.0f ? opts.inside_radius : opts.outside_radius), d);
+        }
+        else
+        {
+            StoreSample(out, i, format, value, value);
+        }
+    }
+}
+
+// Bakes the float field of the selected channels of '*data' with the radii grown by 'reach' output pixels,
+// the unselected channels are resized along as 0..1.
+static bool BakeField(SDFcontext *ctx, BakeOptions const &opts, const unsigned char *data, int w, int h, int comp,
+                      float reach, std::vector<float> *field)
+{
+    int factor = opts.supersample, channels = ChannelsForComp(opts.channels, comp);
+    field->assign((size_t)w * h * comp, 0.0f);
+    for (size_t i = 0; i < field->size(); i++)
+    {
+        if ((channels & (1 << (i % comp))) == 0)
+            (*field)[i] = data[i] * (1.0f / 255.0f);
+    }
+    return sdfContextBuildFloat(ctx, field->data(), w * comp, comp, (opts.outside_radius + reach) * factor,
+                                (opts.inside_radius + reach) * factor, data, w, h, w * comp, comp, channels,
+                                opts.engine) != 0;
+}
+
+bool BakeSupersampled(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int comp)
+{
+    int factor = opts.supersample, w = *width, h = *height;
+    int ow = (w + factor - 1) / factor, oh = (h + factor - 1) / factor;
+    std::vector<float> field, small((size_t)ow * oh * comp);
+    if (!BakeField(ctx, opts, *data, w, h, comp, SUPERSAMPLE_FILTER_REACH, &field) ||
+        !DownsampleField(ctx, field.data(), w, h, small.data(), ow, oh, comp))
+        return false;
+
+    // FreeImage() releases the new pixels like the stb_image ones.
+    unsigned char *out = (unsigned char *)malloc(small.size() * FormatBytes(opts.format));
+    if (out == nullptr)
+        return false;
+    StoreField(opts, opts.format, small.data(), small.size(), comp, ChannelsForComp(opts.channels, comp), factor, out);
+    FreeImage(*data);
+    *data = out;
+    *width = ow;
+    *height = oh;
+    return true;
+}
+
+int MipLevels(BakeOptions const &opts, int width, int height)
+{
+    int levels = 1;
+    if (opts.mips)
+    {
+        while ((width >> levels) > 0 || (height >> levels) > 0)
+            levels++;
+    }
+    return levels;
+}
+
+size_t MipChainSize(int width, int height, int comp, int format, int levels)
+{
+    size_t size = 0;
+    for (int k = 0; k < levels; k++)
+    {
+        int lw = std::max(width >> k, 1), lh = std::max(height >> k, 1);
+        size += format == SDFBAKE_FORMAT_BC ? BlocksSize(lw, lh, comp) : (size_t)lw * lh * comp * FormatBytes(format);
+    }
+    return size;
+}
+
+bool BakeMips(SDFcontext *ctx, BakeOptions const &opts, unsigned char **data, int *width, int *height, int *comp)
+{
+    int factor = opts.supersample, w = *width, h = *height, n = *comp;
+    int ow = (w + factor - 1) / factor, oh = (h + factor - 1) / factor;
+    int levels = MipLevels(opts, ow, oh), channels = ChannelsForComp(opts.channels, n), count = 0;
+    for (int c = 0; c < 4; c++)
+        count += (channels >> c) & 1;
+    bool blocks = opts.format == SDFBAKE_FORMAT_BC;
+    if (blocks && (count == 0 || count > 2))
+    {
+        Error("bc needs one or two baked channels");
+        return false;
+    }
+    int stored = blocks ? count : n;
+
+    // Level k reaches SUPERSAMPLE_FILTER_REACH of its pixels, 1 << k times that in level 0 pixels. The
+    // field is baked that far past the radius for the levels whose pixels are at most the larger radius.
+    // The smaller levels span the radius in less than a pixel and stop the growth: their samples may be
+    // pulled towards the contour by the clamped distances, but the reach stays a few times the radius
+    // instead of the size of the image.
+    float radius = std::max(opts.outside_radius, opts.inside_radius);
+    int reach_level = 0;
+    while (reach_level < levels - 1 && (float)(1 << reach_level) < radius)
+        reach_level++;
+    std::vector<float> field;
+    if (!BakeField(ctx, opts, *data, w, h, n, SUPERSAMPLE_FILTER_REACH * (1 << reach_level), &field))
+        return false;
+    std::vector<size_t> offsets(levels + 1, 0);
+    for (int k = 0; k < levels; k++)
+        offsets[k + 1] = offsets[k] + MipChainSize(std::max(ow >> k, 1), std::max(oh >> k, 1), stored, opts.format, 1);
+    unsigned char *out = (unsigned char *)malloc(offsets[levels]);
+    if (out == nullptr)
+        return false;
+
+    // Every level is resized from the float level above it, and level 0 from the field unless the input is
+    // the output size. Each resize runs on the context threads. All levels keep the radii of level 0, a
+    // shader decodes them alike.
+    int lw = w, lh = h;
+    std::vector<float> level, small;
+    std::vector<unsigned char> bytes;
+    const float *src = field.data();
+    for (int k = 0; k < levels; k++)
+    {
+        int sw = std::max(ow >> k, 1), sh = std::max(oh >> k, 1);
+        if (sw != lw || sh != lh)
+        {
+            small.resize((size_t)sw * sh * n);
+            if (!DownsampleField(ctx, src, lw, lh, small.data(), sw, sh, n))
+            {
+                free(out);
+                return false;
+            }
+            level.swap(small);
+            src = level.data();
+            lw = sw;
+            lh = sh;
+        }
+        if (src != field.data())
+            std::vector<float>().swap(field); // Only the level above is needed from here on.
+        unsigned char *dst = out + offsets[k];
+        if (blocks)
+        {
+            bytes.resize((size_t)lw * lh * n);
+            StoreField(opts, SDF_FORMAT_UNORM8, src, bytes.size(), n, channels, factor, bytes.data());
+            CompressBlocks(bytes.data(), lw, lh, n, channels, dst, 0, lh);
+        }
+        else
+        {
+            StoreField(opts, opts.format, src, (size_t)lw * lh * n, n, channels, factor, dst);
+        }
+    }
+    FreeImage(*data);
+    *data = out;
+    *width = ow;
+    *height = oh;
+    *comp = stored;
+    return true;
+}
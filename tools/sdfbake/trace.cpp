@@ -0,0 +1,89 @@
+// Chrome trace_event JSON, see trace.h. The spans are complete ("X") events in microseconds from the
+// creation of the trace, one process, one tid per thread in the order the threads first traced something.
+
+#include <stdio.h>
+#include <chrono>
+
+#include "trace.h"
+
+uint64_t TraceNow()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string TraceArg(const char *name, std::string const &value)
+{
+    return JsonQuote(name) + ": " + JsonQuote(value);
+}
+
+std::string TraceArg(const char *name, long long value)
+{
+    return JsonQuote(name) + ": " + std::to_string(value);
+}
+
+std::string PhaseArgs(SDFstats const &stats)
+{
+    std::string args = TraceArg("builds", stats.builds);
+    for (int p = 0; p < SDF_PHASE_COUNT; p++)
+    {
+        if (stats.phases[p].start == 0)
+            continue;
+        char ms[32];
+        snprintf(ms, sizeof(ms), "%.3f", stats.phases[p].ns / 1e6);
+        args += ", " + JsonQuote(std::string(sdfPhaseName(p)) + "_ms") + ": " + ms;
+    }
+    return args;
+}
+
+BakeTrace::BakeTrace() : origin(TraceNow()) {}
+
+int BakeTrace::ThreadIndex()
+{
+    std::thread::id id = std::this_thread::get_id();
+    for (auto const &thread : threads)
+    {
+        if (thread.first == id)
+            return thread.second;
+    }
+    int index = (int)threads.size();
+    threads.emplace_back(id, index);
+    events.push_back("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(index) +
+                     ", \"args\": {\"name\": " + JsonQuote(index == 0 ? "main" : "thread " + std::to_string(index)) + "}}");
+    return index;
+}
+
+void BakeTrace::Span(std::string const &name, const char *category, uint64_t start, uint64_t end, std::string const &args)
+{
+    char times[64];
+    snprintf(times, sizeof(times), "\"ts\": %.3f, \"dur\": %.3f", (double)(int64_t)(start - origin) / 1e3,
+             (double)(end - start) / 1e3);
+    std::string event = "{\"name\": " + JsonQuote(name) + ", \"cat\": " + JsonQuote(category) + ", \"ph\": \"X\", " +
+                        times + ", \"pid\": 1, \"tid\": ";
+    std::lock_guard<std::mutex> guard(lock);
+    events.push_back(event + std::to_string(ThreadIndex()) + ", \"args\": {" + args + "}}");
+}
+
+void BakeTrace::Phases(SDFstats const &stats, std::string const &args)
+{
+    if (stats.builds != 1)
+        return;
+    for (int p = 0; p < SDF_PHASE_COUNT; p++)
+    {
+        SDFphaseStats const &phase = stats.phases[p];
+        if (phase.start == 0)
+            continue;
+        std::string more = TraceArg("pixels", (long long)phase.pixels) + ", " + TraceArg("bytes", (long long)phase.bytes);
+        Span(sdfPhaseName(p), "phase", phase.start, phase.start + phase.ns, args.empty() ? more : args + ", " + more);
+    }
+}
+
+bool BakeTrace::Write(std::string const &path)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::string json = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (size_t i = 0; i < events.size(); i++)
+        json += events[i] + (i + 1 < events.size() ? ",\n" : "\n");
+    json += "]}\n";
+    return WriteBytes(path, json.data(), json.size());
+}
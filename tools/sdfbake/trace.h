@@ -0,0 +1,107 @@
+// Chrome trace of a sdfbake run, written with --trace as trace_event JSON for chrome://tracing or
+// https://ui.perfetto.dev.
+//
+// Every thread gets its own track. The files show up as load, bake and encode spans, the channels of a
+// batch as one span each, and the transform inside a bake as its phases: the SDFstats the context
+// filled, placed on the thread that ran the build. The spans are kept in memory and written at the end.
+
+#ifndef SDFBAKE_TRACE_H
+#define SDFBAKE_TRACE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "sdfbake.h"
+
+// Nanoseconds of the steady clock, the clock of SDFphaseStats::start.
+uint64_t TraceNow();
+
+class BakeTrace
+{
+public:
+    BakeTrace();
+
+    // Adds a span of the calling thread. 'args' is empty or the members of a JSON object, e.g.
+    // "\"file\": \"a.png\"", see TraceArg().
+    void Span(std::string const &name, const char *category, uint64_t start, uint64_t end, std::string const &args);
+
+    // Adds the phases of the builds 'stats' covers as spans of the calling thread, with their pixels and
+    // bytes. With more than one build the phases of the builds are summed, and only their totals go to
+    // the span of the whole bake through PhaseArgs() instead.
+    void Phases(SDFstats const &stats, std::string const &args);
+
+    bool Write(std::string const &path);
+
+private:
+    int ThreadIndex(); // Needs 'lock'.
+
+    uint64_t origin;
+    std::mutex lock;
+    std::vector<std::string> events;
+    std::vector<std::pair<std::thread::id, int>> threads;
+};
+
+// A member of the args of a span.
+std::string TraceArg(const char *name, std::string const &value);
+std::string TraceArg(const char *name, long long value);
+
+// Milliseconds of every phase that ran, as span args.
+std::string PhaseArgs(SDFstats const &stats);
+
+// Spans the scope on the calling thread, nothing without a trace.
+class TraceScope
+{
+public:
+    TraceScope(BakeTrace *trace, std::string name, const char *category, std::string args = std::string())
+        : trace(trace), name(std::move(name)), category(category), args(std::move(args)), start(trace != nullptr ? TraceNow() : 0)
+    {
+    }
+    ~TraceScope()
+    {
+        if (trace != nullptr)
+            trace->Span(name, category, start, TraceNow(), args);
+    }
+
+    // More args, known only once the work is done.
+    void AddArgs(std::string const &more) { args += (args.empty() || more.empty() ? "" : ", ") + more; }
+
+private:
+    BakeTrace *trace;
+    std::string name;
+    const char *category;
+    std::string args;
+    uint64_t start;
+};
+
+// Times the context builds of the scope on 'ctx' and adds their phases to the trace, nothing without a trace.
+class TraceBuilds
+{
+public:
+    TraceBuilds(BakeTrace *trace, SDFcontext *ctx, std::string args = std::string())
+        : trace(trace), ctx(ctx), args(std::move(args)), stats()
+    {
+        if (trace != nullptr)
+            sdfContextSetStats(ctx, &stats);
+    }
+    ~TraceBuilds()
+    {
+        if (trace == nullptr)
+            return;
+        sdfContextSetStats(ctx, NULL);
+        trace->Phases(stats, args);
+    }
+
+    SDFstats const &Stats() const { return stats; }
+
+private:
+    BakeTrace *trace;
+    SDFcontext *ctx;
+    std::string args;
+    SDFstats stats;
+};
+
+#endif // SDFBAKE_TRACE_H